@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: MIT
 
 #include "bpf.h"
+#include "key_table.h"
 
 #if !defined(MAX_ENTRIES)
 #define MAX_ENTRIES 1024
@@ -11,12 +12,42 @@
 #define TYPE BPF_MAP_TYPE_HASH
 #endif
 
+// Sizes of the map key and value in bytes. Array maps require a KEY_SIZE of 4.
+#if !defined(KEY_SIZE)
+#define KEY_SIZE 4
+#endif
+
+#if !defined(VALUE_SIZE)
+#define VALUE_SIZE 4
+#endif
+
+#if KEY_SIZE < 4 || VALUE_SIZE < 4
+#error "KEY_SIZE and VALUE_SIZE must be at least 4"
+#endif
+
+// The index is followed by padding up to KEY_SIZE, which is always zero so that the key hashes over all of its bytes.
+typedef struct _map_key
+{
+    int index;
+#if KEY_SIZE > 4
+    unsigned char padding[KEY_SIZE - 4];
+#endif
+} map_key;
+
+typedef struct _map_value
+{
+    int index;
+#if VALUE_SIZE > 4
+    unsigned char data[VALUE_SIZE - 4];
+#endif
+} map_value;
+
 struct
 {
     __uint(type, TYPE);
     __uint(max_entries, MAX_ENTRIES);
-    __type(key, int);
-    __type(value, int);
+    __type(key, map_key);
+    __type(value, map_value);
 } map SEC(".maps");
 
 struct
@@ -27,13 +58,32 @@ struct
     __type(value, int);
 } map_init SEC(".maps");
 
+// Percentages of mixed operations that are lookups, updates and deletes, set by the parameters of the test. They must
+// add up to 100.
+PARAMETER unsigned int read_percent = 100;
+PARAMETER unsigned int update_percent = 0;
+PARAMETER unsigned int delete_percent = 0;
+
+// Number of keys mixed operations are spread over, at most MAX_ENTRIES.
+PARAMETER unsigned int key_count = MAX_ENTRIES;
+
+// Percentage of read_mixed lookups that use a key inserted by prepare, set by the test with map_population.
+struct
+{
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, int);
+    __type(value, int);
+} lookup_hit_percent SEC(".maps");
+
 SEC("sockops/prepare") int prepare(void* ctx)
 {
     int key = 0;
     int* value = bpf_map_lookup_elem(&map_init, &key);
     if (value && *value < MAX_ENTRIES) {
-        int i = *value;
-        bpf_map_update_elem(&map, &i, &i, BPF_ANY);
+        map_key element_key = {.index = *value};
+        map_value element_value = {.index = *value};
+        bpf_map_update_elem(&map, &element_key, &element_value, BPF_ANY);
         *value += 1;
     }
     return 0;
@@ -41,25 +91,88 @@ SEC("sockops/prepare") int prepare(void* ctx)
 
 SEC("sockops/read") int read(void* ctx)
 {
-    int key = bpf_get_prandom_u32() % MAX_ENTRIES;
-    int* value = bpf_map_lookup_elem(&map, &key);
+    map_key key = {.index = select_key(MAX_ENTRIES)};
+    map_value* value = bpf_map_lookup_elem(&map, &key);
     if (value) {
         return 0;
     }
     return 1;
 }
 
+// Look up a key inserted by prepare, which inserts keys [0, n) with n set by its iteration count.
+static inline int
+lookup_hit()
+{
+    int zero = 0;
+    int* count = bpf_map_lookup_elem(&map_init, &zero);
+    if (!count || *count <= 0) {
+        return 1;
+    }
+    map_key key = {.index = select_key(*count)};
+    return bpf_map_lookup_elem(&map, &key) ? 0 : 1;
+}
+
+// Look up a key that is never inserted, as all other programs use keys below MAX_ENTRIES.
+static inline int
+lookup_miss()
+{
+    map_key key = {.index = MAX_ENTRIES + select_key(MAX_ENTRIES)};
+    return bpf_map_lookup_elem(&map, &key) ? 0 : 1;
+}
+
+SEC("sockops/read_hit") int read_hit(void* ctx)
+{
+    return lookup_hit();
+}
+
+SEC("sockops/read_miss") int read_miss(void* ctx)
+{
+    return lookup_miss();
+}
+
+SEC("sockops/read_mixed") int read_mixed(void* ctx)
+{
+    int zero = 0;
+    int* hit_percent = bpf_map_lookup_elem(&lookup_hit_percent, &zero);
+    if (hit_percent && (int)(bpf_get_prandom_u32() % 100) < *hit_percent) {
+        return lookup_hit();
+    }
+    return lookup_miss();
+}
+
 SEC("sockops/update") int update(void* ctx)
 {
-    int key = bpf_get_prandom_u32() % MAX_ENTRIES;
-    bpf_map_update_elem(&map, &key, &key, BPF_ANY);
+    map_key key = {.index = select_key(MAX_ENTRIES)};
+    map_value value = {.index = key.index};
+    bpf_map_update_elem(&map, &key, &value, BPF_ANY);
     return 0;
 }
 
 SEC("sockops/replace") int replace(void* ctx)
 {
-    int key = bpf_get_prandom_u32() % MAX_ENTRIES;
+    map_key key = {.index = select_key(MAX_ENTRIES)};
+    map_value value = {.index = key.index};
     (void)bpf_map_delete_elem(&map, &key);
-    (void)bpf_map_update_elem(&map, &key, &key, BPF_ANY);
+    (void)bpf_map_update_elem(&map, &key, &value, BPF_ANY);
+    return 0;
+}
+
+// Look up, update or delete a key, in the proportions set by the parameters.
+SEC("sockops/mixed") int mixed(void* ctx)
+{
+    if (read_percent + update_percent + delete_percent != 100 || key_count == 0 || key_count > MAX_ENTRIES) {
+        return 1;
+    }
+
+    map_key key = {.index = select_key(key_count)};
+    unsigned int operation = bpf_get_prandom_u32() % 100;
+    if (operation < read_percent) {
+        (void)bpf_map_lookup_elem(&map, &key);
+    } else if (operation < read_percent + update_percent) {
+        map_value value = {.index = key.index};
+        (void)bpf_map_update_elem(&map, &key, &value, BPF_ANY);
+    } else {
+        (void)bpf_map_delete_elem(&map, &key);
+    }
     return 0;
 }
@@ -0,0 +1,103 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+// Key selection for the map tests. By default keys are uniformly distributed. Objects built with KEY_TABLE select
+// their keys as set by the key_distribution parameter:
+// - KEY_DISTRIBUTION_UNIFORM: keys are uniformly distributed.
+// - KEY_DISTRIBUTION_SEQUENTIAL: each CPU walks the keys key_stride apart, starting at a random key. With a key_stride
+//   coprime to the number of keys, every key is visited.
+// - KEY_DISTRIBUTION_TABLE: keys are drawn from the inverse CDF of a distribution, which the runner writes to key_table
+//   with a map_population quantiles generator, for example zipf or hot_set. Entry i holds the rank at quantile
+//   i / KEY_TABLE_SIZE. A draw picks a random entry and then a random rank between that entry and the next one, so
+//   every rank can be drawn, and popular ranks that span several entries are drawn in proportion. With key_scramble,
+//   ranks are mapped to keys by a multiplicative permutation, so that the popular keys are spread over the map
+//   instead of being the smallest ones.
+
+#if defined(KEY_TABLE)
+
+// Must be a power of two.
+#if !defined(KEY_TABLE_SIZE)
+#define KEY_TABLE_SIZE 65536
+#endif
+
+#define KEY_DISTRIBUTION_UNIFORM 0
+#define KEY_DISTRIBUTION_SEQUENTIAL 1
+#define KEY_DISTRIBUTION_TABLE 2
+
+// Prime, and so coprime to any number of keys that is not a multiple of it.
+#define KEY_SCRAMBLE_MULTIPLIER 2654435761ull
+
+PARAMETER unsigned int key_distribution = KEY_DISTRIBUTION_UNIFORM;
+PARAMETER unsigned int key_stride = 1;
+PARAMETER unsigned int key_scramble = 0;
+
+typedef struct _key_sequence_position
+{
+    unsigned int next;
+    unsigned int started;
+} key_sequence_position;
+
+struct
+{
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, KEY_TABLE_SIZE);
+    __type(key, unsigned int);
+    __type(value, unsigned int);
+} key_table SEC(".maps");
+
+struct
+{
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, unsigned int);
+    __type(value, key_sequence_position);
+} key_sequence_positions SEC(".maps");
+
+#endif
+
+// Select the key of the next operation, in the range [0, max_entries).
+static inline unsigned int
+select_key(unsigned int max_entries)
+{
+#if defined(KEY_TABLE)
+    if (key_distribution == KEY_DISTRIBUTION_SEQUENTIAL) {
+        unsigned int zero = 0;
+        key_sequence_position* position = bpf_map_lookup_elem(&key_sequence_positions, &zero);
+        if (!position) {
+            return 0;
+        }
+        if (!position->started) {
+            position->next = bpf_get_prandom_u32();
+            position->started = 1;
+        }
+
+        unsigned int key = position->next % max_entries;
+        position->next = (unsigned int)(((unsigned long long)key + key_stride) % max_entries);
+        return key;
+    }
+
+    if (key_distribution == KEY_DISTRIBUTION_TABLE) {
+        unsigned int slot = bpf_get_prandom_u32() % KEY_TABLE_SIZE;
+        unsigned int next_slot = slot + 1;
+        unsigned int* first = bpf_map_lookup_elem(&key_table, &slot);
+        if (!first) {
+            return 0;
+        }
+        // The ranks of the last entry run up to the last key.
+        unsigned int* next = bpf_map_lookup_elem(&key_table, &next_slot);
+        unsigned int last = next ? *next : max_entries - 1;
+        unsigned int rank = *first;
+        if (last > rank) {
+            rank += bpf_get_prandom_u32() % (last - rank + 1);
+        }
+
+        if (key_scramble) {
+            return (unsigned int)(((unsigned long long)rank + 1) * KEY_SCRAMBLE_MULTIPLIER % max_entries);
+        }
+        return rank % max_entries;
+    }
+#endif
+    return bpf_get_prandom_u32() % max_entries;
+}
@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: MIT
 
 #include "bpf.h"
+#include "key_table.h"
 #include "lpm.h"
 
 #if !defined(MAX_ENTRIES)
@@ -80,7 +81,7 @@ SEC("sockops/prepare") int prepare(void* ctx)
 
 SEC("sockops/read") int read(void* ctx)
 {
-    unsigned int key = bpf_get_prandom_u32() % MAX_ENTRIES;
+    unsigned int key = select_key(MAX_ENTRIES);
 
     ipv4_route* test_route = bpf_map_lookup_elem(&lpm_routes_map, &key);
     ipv4_route test_address = {32, 0};
@@ -124,7 +125,7 @@ SEC("sockops/read") int read(void* ctx)
 
 SEC("sockops/update") int update(void* ctx)
 {
-    unsigned int key = bpf_get_prandom_u32() % MAX_ENTRIES;
+    unsigned int key = select_key(MAX_ENTRIES);
 
     ipv4_route* test_route = bpf_map_lookup_elem(&lpm_routes_map, &key);
     ipv4_route route_key = {32, 0};
@@ -141,7 +142,7 @@ SEC("sockops/update") int update(void* ctx)
 
 SEC("sockops/replace") int replace(void* ctx)
 {
-    unsigned int key = bpf_get_prandom_u32() % MAX_ENTRIES;
+    unsigned int key = select_key(MAX_ENTRIES);
 
     ipv4_route* test_route = bpf_map_lookup_elem(&lpm_routes_map, &key);
     ipv4_route route_key = {32, 0};
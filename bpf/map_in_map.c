@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: MIT
 
 #include "bpf.h"
+#include "key_table.h"
 
 #if !defined(MAX_ENTRIES)
 #define MAX_ENTRIES 8192
@@ -53,7 +54,7 @@ SEC("sockops/prepare") int prepare(void* ctx)
 SEC("sockops/read") int read(void* ctx)
 {
     int outer_key = 0;
-    int key = bpf_get_prandom_u32() % MAX_ENTRIES;
+    int key = select_key(MAX_ENTRIES);
     void* map = bpf_map_lookup_elem(&outer_map, &outer_key);
     if (!map) {
         return 2;
@@ -69,7 +70,7 @@ SEC("sockops/read") int read(void* ctx)
 SEC("sockops/update") int update(void* ctx)
 {
     int outer_key = 0;
-    int key = bpf_get_prandom_u32() % MAX_ENTRIES;
+    int key = select_key(MAX_ENTRIES);
     void* map = bpf_map_lookup_elem(&outer_map, &outer_key);
     if (!map) {
         return 1;
@@ -11,6 +11,18 @@
 #define RECORD_SIZE 128
 #endif
 
+#if RECORD_SIZE < 8
+#error "RECORD_SIZE must be at least 8 to hold a timestamp"
+#endif
+
+#if defined(PLATFORM_LINUX)
+#include <asm-generic/errno-base.h>
+#endif
+
+// Returned by the programs that feed a consumer when the buffer was full and their record was dropped. The runner
+// counts these as drops, and any other failure as a failed test.
+#define RECORD_DROPPED 2
+
 struct
 {
     __uint(type, BPF_MAP_TYPE_RINGBUF);
@@ -25,6 +37,24 @@ struct
     __uint(value_size, RECORD_SIZE);
 } buf_map SEC(".maps");
 
+// Records written by output_timestamped, per CPU so that each CPU can stamp its own.
+struct
+{
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __type(key, int);
+    __uint(max_entries, 1);
+    __uint(value_size, RECORD_SIZE);
+} stamped_buf_map SEC(".maps");
+
+#if defined(PLATFORM_LINUX)
+struct
+{
+    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+    __uint(key_size, sizeof(int));
+    __uint(value_size, sizeof(int));
+} perf_map SEC(".maps");
+#endif
+
 SEC("sockops/bpf_ringbuf_output") int output(void* ctx)
 {
     int key = 0;
@@ -38,3 +68,83 @@ SEC("sockops/bpf_ringbuf_output") int output(void* ctx)
         return 0;
     }
 }
+
+// Output a record that starts with the time it was produced, so that a consumer can measure how long it waited.
+static inline int
+output_stamped_record(unsigned long flags)
+{
+    int key = 0;
+    unsigned long* msg = bpf_map_lookup_elem(&stamped_buf_map, &key);
+    if (!msg) {
+        return 1;
+    }
+    *msg = bpf_ktime_get_ns();
+    // The size and flags are valid, so the output can only fail for lack of space.
+    if (bpf_ringbuf_output(&rb_map, msg, RECORD_SIZE, flags) < 0) {
+        return RECORD_DROPPED;
+    } else {
+        return 0;
+    }
+}
+
+SEC("sockops/bpf_ringbuf_output_timestamped") int output_timestamped(void* ctx)
+{
+    return output_stamped_record(0);
+}
+
+#if defined(PLATFORM_LINUX)
+// Reserve a record in the ring buffer, stamp it in place and submit it. Unlike bpf_ringbuf_output, this needs no
+// separate buffer to build the record in and copy it from.
+static inline int
+reserve_submit_stamped_record(unsigned long flags)
+{
+    unsigned long* record = bpf_ringbuf_reserve(&rb_map, RECORD_SIZE, 0);
+    if (!record) {
+        return RECORD_DROPPED;
+    }
+    *record = bpf_ktime_get_ns();
+    bpf_ringbuf_submit(record, flags);
+    return 0;
+}
+
+SEC("sockops/bpf_ringbuf_output_no_wakeup") int output_no_wakeup(void* ctx)
+{
+    return output_stamped_record(BPF_RB_NO_WAKEUP);
+}
+
+SEC("sockops/bpf_ringbuf_output_force_wakeup") int output_force_wakeup(void* ctx)
+{
+    return output_stamped_record(BPF_RB_FORCE_WAKEUP);
+}
+
+SEC("sockops/bpf_ringbuf_reserve_submit") int reserve_submit(void* ctx)
+{
+    return reserve_submit_stamped_record(0);
+}
+
+SEC("sockops/bpf_ringbuf_reserve_submit_no_wakeup") int reserve_submit_no_wakeup(void* ctx)
+{
+    return reserve_submit_stamped_record(BPF_RB_NO_WAKEUP);
+}
+
+SEC("sockops/bpf_ringbuf_reserve_submit_force_wakeup") int reserve_submit_force_wakeup(void* ctx)
+{
+    return reserve_submit_stamped_record(BPF_RB_FORCE_WAKEUP);
+}
+
+// Output a stamped record to the perf event buffer of the current CPU.
+SEC("sockops/bpf_perf_event_output") int perf_event_output(void* ctx)
+{
+    int key = 0;
+    unsigned long* msg = bpf_map_lookup_elem(&stamped_buf_map, &key);
+    if (!msg) {
+        return 1;
+    }
+    *msg = bpf_ktime_get_ns();
+    long result = bpf_perf_event_output(ctx, &perf_map, BPF_F_CURRENT_CPU, msg, RECORD_SIZE);
+    if (result == -ENOSPC) {
+        return RECORD_DROPPED;
+    }
+    return result < 0 ? 1 : 0;
+}
+#endif
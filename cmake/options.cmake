@@ -4,6 +4,7 @@
 option(BPF_PERF_INSTALL_GIT_HOOKS "Set to true to install git hooks" ON)
 option(BPF_PERF_LOCAL_NUGET_PATH "Use a local NuGet package to install dependencies")
 option(BPF_XDP_TEST_ENABLED "Set to true to enable XDP tests")
+option(BPF_PERF_BUILD_VARIANTS "Set to true to also build every BPF test case with each compiler flag variant")
 
 # Note that the compile_commands.json file is only exporter when
 # using the Ninja or Makefile generator
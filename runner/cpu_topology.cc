@@ -0,0 +1,181 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "cpu_topology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+std::set<size_t>
+parse_cpu_list(const std::string& list)
+{
+    std::set<size_t> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty()) {
+            continue;
+        }
+        size_t dash = range.find('-');
+        try {
+            size_t first = std::stoul(range.substr(0, dash));
+            size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+            for (size_t cpu = first; cpu <= last; cpu++) {
+                cpus.insert(cpu);
+            }
+        } catch (std::exception&) {
+            // Leave out ranges that are not numbers, such as the flags of isolcpus.
+        }
+    }
+    return cpus;
+}
+
+#if defined(__linux__)
+// Read the first line of a sysfs attribute.
+static std::optional<std::string>
+_read_first_line(const std::string& path)
+{
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line)) {
+        return {};
+    }
+    return line;
+}
+
+// Read a sysfs attribute holding an integer.
+static std::optional<int>
+_read_int_attribute(const std::string& path)
+{
+    auto value = _read_first_line(path);
+    if (!value.has_value()) {
+        return {};
+    }
+    try {
+        return std::stoi(value.value());
+    } catch (std::exception&) {
+        return {};
+    }
+}
+#endif
+
+// Parse a number that is part of a selector.
+static size_t
+_parse_selector_number(const std::string& selector, const std::string& number)
+{
+    if (number.empty() || number.find_first_not_of("0123456789") != std::string::npos) {
+        throw std::runtime_error("Invalid CPU selector " + selector);
+    }
+    return std::stoul(number);
+}
+
+cpu_topology::cpu_topology(size_t cpu_count) : locations(cpu_count)
+{
+#if defined(__linux__)
+    for (size_t cpu = 0; cpu < cpu_count; cpu++) {
+        std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        auto& location = locations[cpu];
+        location.socket = _read_int_attribute(topology + "physical_package_id");
+        location.core = _read_int_attribute(topology + "core_id");
+        location.smt_siblings = parse_cpu_list(_read_first_line(topology + "thread_siblings_list").value_or(""));
+    }
+    for (size_t node : parse_cpu_list(_read_first_line("/sys/devices/system/node/online").value_or(""))) {
+        std::string cpulist = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+        for (size_t cpu : parse_cpu_list(_read_first_line(cpulist).value_or(""))) {
+            if (cpu < cpu_count) {
+                locations[cpu].node = static_cast<int>(node);
+            }
+        }
+    }
+#endif
+}
+
+const cpu_location&
+cpu_topology::location(size_t cpu) const
+{
+    return locations.at(cpu);
+}
+
+std::vector<size_t>
+cpu_topology::select(const std::string& selector) const
+{
+    // The first CPU of each core, in CPU order, keyed by socket and core.
+    auto first_per_core = [this](const std::string& selector) {
+        std::map<std::pair<int, int>, size_t> cores;
+        for (size_t cpu = 0; cpu < locations.size(); cpu++) {
+            auto& location = locations[cpu];
+            if (!location.socket.has_value() || !location.core.has_value()) {
+                throw std::runtime_error(
+                    "CPU selector " + selector + " needs the CPU topology, which is not available");
+            }
+            cores.insert({{location.socket.value(), location.core.value()}, cpu});
+        }
+        std::set<size_t> cpus;
+        for (auto& [core, cpu] : cores) {
+            cpus.insert(cpu);
+        }
+        return cpus;
+    };
+
+    std::set<size_t> cpus;
+    size_t colon = selector.find(':');
+    std::string kind = selector.substr(0, colon);
+    if (selector.find_first_not_of("0123456789-") == std::string::npos) {
+        size_t dash = selector.find('-');
+        size_t first = _parse_selector_number(selector, selector.substr(0, dash));
+        size_t last = dash == std::string::npos ? first : _parse_selector_number(selector, selector.substr(dash + 1));
+        if (first > last) {
+            throw std::runtime_error("Invalid CPU selector " + selector);
+        }
+        if (last >= locations.size()) {
+            throw std::runtime_error("Invalid CPU number " + std::to_string(last));
+        }
+        for (size_t cpu = first; cpu <= last; cpu++) {
+            cpus.insert(cpu);
+        }
+    } else if (colon != std::string::npos && (kind == "node" || kind == "socket")) {
+        int index = static_cast<int>(_parse_selector_number(selector, selector.substr(colon + 1)));
+        for (size_t cpu = 0; cpu < locations.size(); cpu++) {
+            auto& value = kind == "node" ? locations[cpu].node : locations[cpu].socket;
+            if (value == index) {
+                cpus.insert(cpu);
+            }
+        }
+    } else if (colon != std::string::npos && kind == "smt_siblings_of") {
+        size_t cpu = _parse_selector_number(selector, selector.substr(colon + 1));
+        if (cpu >= locations.size()) {
+            throw std::runtime_error("Invalid CPU number " + std::to_string(cpu));
+        }
+        cpus = locations[cpu].smt_siblings;
+    } else if (selector == "one_per_core") {
+        cpus = first_per_core(selector);
+    } else if (selector == "cross_node_pairs") {
+        std::map<int, std::vector<size_t>> node_cpus;
+        for (size_t cpu : first_per_core(selector)) {
+            if (locations[cpu].node.has_value()) {
+                node_cpus[locations[cpu].node.value()].push_back(cpu);
+            }
+        }
+        if (node_cpus.size() < 2) {
+            throw std::runtime_error("CPU selector cross_node_pairs needs at least two NUMA nodes with CPUs");
+        }
+        auto& first_node = node_cpus.begin()->second;
+        auto& second_node = std::next(node_cpus.begin())->second;
+        for (size_t i = 0; i < std::min(first_node.size(), second_node.size()); i++) {
+            cpus.insert(first_node[i]);
+            cpus.insert(second_node[i]);
+        }
+    } else {
+        throw std::runtime_error("Invalid CPU selector " + selector);
+    }
+
+    if (cpus.empty()) {
+        throw std::runtime_error("CPU selector " + selector + " matches no CPUs");
+    }
+    return std::vector<size_t>(cpus.begin(), cpus.end());
+}
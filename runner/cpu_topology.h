@@ -0,0 +1,73 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Parse a CPU list in the format of sysfs and the kernel command line, such as "1,4-7", into the CPUs it names.
+ * Entries that are not numbers or ranges, such as the flags of isolcpus, are left out.
+ */
+std::set<size_t>
+parse_cpu_list(const std::string& list);
+
+/**
+ * @brief Where a CPU is in the topology of the host. Values that could not be read are left empty.
+ */
+struct cpu_location
+{
+    std::optional<int> node;
+    std::optional<int> socket;
+    // Index of the core within its socket.
+    std::optional<int> core;
+    // CPUs that share the core with this one, including this one.
+    std::set<size_t> smt_siblings;
+};
+
+/**
+ * @brief The NUMA nodes, sockets and cores of the CPUs, read from sysfs, for selecting CPUs by where they are.
+ *
+ * The topology is only read on Linux. Elsewhere every location is empty, and only selectors by CPU number work.
+ */
+class cpu_topology
+{
+  public:
+    /**
+     * @brief Read the topology of CPUs 0 to cpu_count - 1.
+     */
+    explicit cpu_topology(size_t cpu_count);
+
+    /**
+     * @brief Get the location of a CPU.
+     */
+    const cpu_location&
+    location(size_t cpu) const;
+
+    /**
+     * @brief Get the CPUs named by a selector, in ascending order.
+     *
+     * A selector is one of:
+     * - N: CPU N.
+     * - A-B: CPUs A to B.
+     * - node:N: the CPUs of NUMA node N.
+     * - socket:N: the CPUs of socket N.
+     * - smt_siblings_of:N: CPU N and the CPUs that share its core.
+     * - one_per_core: the first CPU of each core.
+     * - cross_node_pairs: one CPU per core from each of the first two NUMA nodes, as many from each, so that every
+     *   CPU on one node has a partner on the other.
+     *
+     * @param[in] selector The selector.
+     * @return The CPUs.
+     * @throw std::runtime_error if the selector is invalid or names no CPUs.
+     */
+    std::vector<size_t>
+    select(const std::string& selector) const;
+
+  private:
+    std::vector<cpu_location> locations;
+};
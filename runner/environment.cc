@@ -0,0 +1,163 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "environment.h"
+
+#include "cpu_topology.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <set>
+
+#if defined(__linux__)
+#include <sys/utsname.h>
+#endif
+
+// Read the first line of a file, such as a sysctl or sysfs attribute.
+static std::optional<std::string>
+_read_first_line(const std::string& path)
+{
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line)) {
+        return {};
+    }
+    return line;
+}
+
+// Get the sysfs directory of a CPU.
+static std::string
+_cpu_directory(size_t cpu)
+{
+    return "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+}
+
+// Get the value of the first line of /proc/cpuinfo with the given field name.
+static std::optional<std::string>
+_cpuinfo_field(const std::string& name)
+{
+    std::ifstream in("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string field = line.substr(0, colon);
+        field.erase(field.find_last_not_of(" \t") + 1);
+        if (field == name) {
+            return line.substr(std::min(colon + 2, line.size()));
+        }
+    }
+    return {};
+}
+
+environment_fingerprint
+capture_environment_fingerprint()
+{
+    environment_fingerprint fingerprint;
+#if defined(__linux__)
+    auto add = [&fingerprint](const std::string& name, const std::optional<std::string>& value) {
+        if (value.has_value()) {
+            fingerprint.push_back({name, value.value()});
+        }
+    };
+
+    utsname name;
+    if (uname(&name) == 0) {
+        fingerprint.push_back({"kernel", name.release});
+    }
+    add("bpf_jit_enable", _read_first_line("/proc/sys/net/core/bpf_jit_enable"));
+    add("bpf_jit_harden", _read_first_line("/proc/sys/net/core/bpf_jit_harden"));
+    add("bpf_stats_enabled", _read_first_line("/proc/sys/kernel/bpf_stats_enabled"));
+    add("cpu_model", _cpuinfo_field("model name"));
+    add("microcode", _cpuinfo_field("microcode"));
+
+    // CPUs can be set up differently, so list every governor in use and the range of frequencies.
+    std::set<std::string> governors;
+    std::optional<uint64_t> min_frequency, max_frequency;
+    for (size_t cpu : parse_cpu_list(_read_first_line("/sys/devices/system/cpu/online").value_or(""))) {
+        auto governor = _read_first_line(_cpu_directory(cpu) + "/cpufreq/scaling_governor");
+        if (governor.has_value()) {
+            governors.insert(governor.value());
+        }
+        auto frequency = _read_first_line(_cpu_directory(cpu) + "/cpufreq/scaling_cur_freq");
+        if (frequency.has_value()) {
+            try {
+                uint64_t mhz = std::stoull(frequency.value()) / 1000;
+                min_frequency = std::min(min_frequency.value_or(mhz), mhz);
+                max_frequency = std::max(max_frequency.value_or(mhz), mhz);
+            } catch (std::exception&) {
+            }
+        }
+    }
+    if (!governors.empty()) {
+        std::string list;
+        for (auto& governor : governors) {
+            list += (list.empty() ? "" : "/") + governor;
+        }
+        fingerprint.push_back({"governor", list});
+    }
+    if (min_frequency.has_value()) {
+        fingerprint.push_back(
+            {"frequency_mhz",
+             min_frequency == max_frequency
+                 ? std::to_string(min_frequency.value())
+                 : std::to_string(min_frequency.value()) + "-" + std::to_string(max_frequency.value())});
+    }
+
+    add("smt", _read_first_line("/sys/devices/system/cpu/smt/control"));
+    // intel_pstate reports whether turbo is disabled, and acpi-cpufreq whether boost is enabled.
+    auto no_turbo = _read_first_line("/sys/devices/system/cpu/intel_pstate/no_turbo");
+    auto boost = _read_first_line("/sys/devices/system/cpu/cpufreq/boost");
+    if (no_turbo.has_value()) {
+        fingerprint.push_back({"turbo", no_turbo.value() == "0" ? "on" : "off"});
+    } else if (boost.has_value()) {
+        fingerprint.push_back({"turbo", boost.value() == "1" ? "on" : "off"});
+    }
+    auto isolated = _read_first_line("/sys/devices/system/cpu/isolated");
+    if (isolated.has_value()) {
+        fingerprint.push_back({"isolcpus", isolated->empty() ? "none" : isolated.value()});
+    }
+    auto nohz_full = _read_first_line("/sys/devices/system/cpu/nohz_full");
+    if (nohz_full.has_value()) {
+        fingerprint.push_back({"nohz_full", nohz_full->empty() || nohz_full == "(null)" ? "none" : nohz_full.value()});
+    }
+    // The active mode is the one in brackets, as in "always [madvise] never".
+    auto transparent_hugepage = _read_first_line("/sys/kernel/mm/transparent_hugepage/enabled");
+    if (transparent_hugepage.has_value()) {
+        size_t start = transparent_hugepage->find('[');
+        size_t end = transparent_hugepage->find(']');
+        if (start != std::string::npos && end != std::string::npos && end > start) {
+            fingerprint.push_back({"transparent_hugepage", transparent_hugepage->substr(start + 1, end - start - 1)});
+        }
+    }
+#endif
+    return fingerprint;
+}
+
+std::vector<std::string>
+preflight_problems(const std::vector<size_t>& cpus)
+{
+    std::vector<std::string> problems;
+#if defined(__linux__)
+    auto isolated = parse_cpu_list(_read_first_line("/sys/devices/system/cpu/isolated").value_or(""));
+    for (size_t cpu : cpus) {
+        std::string name = "CPU " + std::to_string(cpu);
+        if (isolated.find(cpu) == isolated.end()) {
+            problems.push_back(name + " is not isolated with isolcpus");
+        }
+        // Without cpufreq, as in most virtual machines, the frequency is not controlled by this host.
+        auto governor = _read_first_line(_cpu_directory(cpu) + "/cpufreq/scaling_governor");
+        if (governor.has_value() && governor.value() != "performance") {
+            problems.push_back(name + " uses the " + governor.value() + " governor instead of performance");
+        }
+    }
+#else
+    (void)cpus;
+    problems.push_back("Preflight checks are only supported on Linux");
+#endif
+    return problems;
+}
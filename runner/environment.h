@@ -0,0 +1,38 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The state of the host that the results depend on, such as the kernel version, the BPF JIT settings and CPU
+ * frequency scaling, as name and value pairs. Results are only comparable between runs with the same fingerprint.
+ */
+typedef std::vector<std::pair<std::string, std::string>> environment_fingerprint;
+
+/**
+ * @brief Capture the fingerprint of the host.
+ *
+ * On Linux it includes the kernel release, bpf_jit_enable, bpf_jit_harden and bpf_stats_enabled, the CPU model and
+ * microcode, the frequency governors and the range of current frequencies of the CPUs, whether SMT and turbo are on,
+ * the isolated and nohz_full CPUs, and the transparent huge page mode. Values that cannot be read are left out.
+ *
+ * @return The fingerprint.
+ */
+environment_fingerprint
+capture_environment_fingerprint();
+
+/**
+ * @brief Check whether the given CPUs are set up for measurements with little noise: isolated from the scheduler, and
+ * running the performance frequency governor.
+ *
+ * @param[in] cpus The CPUs the tests run on.
+ * @return A description of each problem found. The checks are only supported on Linux; elsewhere the only problem
+ * reported is that.
+ */
+std::vector<std::string>
+preflight_problems(const std::vector<size_t>& cpus);
@@ -0,0 +1,78 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "histogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+// Number of linear sub-buckets per power of two.
+#define SUB_BUCKET_COUNT (static_cast<uint64_t>(1) << log_linear_histogram::SUB_BUCKET_BITS)
+
+// Values with their most significant bit at position 63 land in the last group.
+#define BUCKET_COUNT ((64 - log_linear_histogram::SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT)
+
+log_linear_histogram::log_linear_histogram() : counts(BUCKET_COUNT) {}
+
+size_t
+log_linear_histogram::bucket_index(uint64_t value)
+{
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    // Keep the SUB_BUCKET_BITS + 1 most significant bits of the value; the top bit selects the group.
+    size_t most_significant_bit = 63 - std::countl_zero(value);
+    size_t group = most_significant_bit - SUB_BUCKET_BITS + 1;
+    uint64_t mantissa = value >> (group - 1);
+    return static_cast<size_t>(group * SUB_BUCKET_COUNT + (mantissa - SUB_BUCKET_COUNT));
+}
+
+uint64_t
+log_linear_histogram::bucket_highest_value(size_t index)
+{
+    size_t group = index / SUB_BUCKET_COUNT;
+    if (group == 0) {
+        return index;
+    }
+    uint64_t mantissa = (index % SUB_BUCKET_COUNT) + SUB_BUCKET_COUNT;
+    uint64_t lowest_value = mantissa << (group - 1);
+    return lowest_value + ((static_cast<uint64_t>(1) << (group - 1)) - 1);
+}
+
+void
+log_linear_histogram::record(uint64_t value)
+{
+    counts[bucket_index(value)]++;
+    total_count++;
+    max_value = std::max(max_value, value);
+}
+
+void
+log_linear_histogram::merge(const log_linear_histogram& other)
+{
+    for (size_t i = 0; i < counts.size(); i++) {
+        counts[i] += other.counts[i];
+    }
+    total_count += other.total_count;
+    max_value = std::max(max_value, other.max_value);
+}
+
+uint64_t
+log_linear_histogram::value_at_percentile(double percentile) const
+{
+    if (total_count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil((percentile / 100.0) * static_cast<double>(total_count)));
+    rank = std::clamp<uint64_t>(rank, 1, total_count);
+
+    uint64_t cumulative_count = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        cumulative_count += counts[i];
+        if (cumulative_count >= rank) {
+            return std::min(bucket_highest_value(i), max_value);
+        }
+    }
+    return max_value;
+}
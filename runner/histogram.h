@@ -0,0 +1,79 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief A log-linear histogram of non-negative integer values, in the style of HdrHistogram.
+ *
+ * Values below 2^SUB_BUCKET_BITS are recorded exactly. Larger values are grouped by their most significant bit, and
+ * each group is split into 2^SUB_BUCKET_BITS linear sub-buckets, so every value is recorded with a relative error of
+ * at most 2^-SUB_BUCKET_BITS (about 3%) using a fixed amount of memory.
+ */
+class log_linear_histogram
+{
+  public:
+    static const size_t SUB_BUCKET_BITS = 5;
+
+    log_linear_histogram();
+
+    /**
+     * @brief Record a single value.
+     *
+     * @param[in] value The value to record.
+     */
+    void
+    record(uint64_t value);
+
+    /**
+     * @brief Add all values recorded in another histogram to this one.
+     *
+     * @param[in] other The histogram to merge.
+     */
+    void
+    merge(const log_linear_histogram& other);
+
+    /**
+     * @brief Get the number of recorded values.
+     */
+    uint64_t
+    count() const
+    {
+        return total_count;
+    }
+
+    /**
+     * @brief Get the largest recorded value, or 0 if the histogram is empty.
+     */
+    uint64_t
+    max() const
+    {
+        return max_value;
+    }
+
+    /**
+     * @brief Get the value at the given percentile.
+     *
+     * The result is the highest value that falls in the same bucket as the value of the given rank, capped at the
+     * largest recorded value, so it never understates the percentile.
+     *
+     * @param[in] percentile Percentile in the range [0, 100].
+     * @return The value at the percentile, or 0 if the histogram is empty.
+     */
+    uint64_t
+    value_at_percentile(double percentile) const;
+
+  private:
+    static size_t
+    bucket_index(uint64_t value);
+    static uint64_t
+    bucket_highest_value(size_t index);
+
+    std::vector<uint64_t> counts;
+    uint64_t total_count = 0;
+    uint64_t max_value = 0;
+};
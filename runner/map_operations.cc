@@ -0,0 +1,204 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "map_operations.h"
+
+#include "map_snapshot.h"
+
+#include <algorithm>
+#include <bpf/bpf.h>
+#include <cerrno>
+#include <cstring>
+#include <map>
+
+static const std::map<std::string, map_operation_kind> _map_operation_names = {
+    {"lookup", map_operation_kind::lookup},
+    {"update", map_operation_kind::update},
+    {"delete", map_operation_kind::delete_element},
+    {"lookup_and_delete", map_operation_kind::lookup_and_delete},
+    {"get_next_key", map_operation_kind::get_next_key},
+    {"lookup_batch", map_operation_kind::lookup_batch},
+    {"update_batch", map_operation_kind::update_batch},
+    {"delete_batch", map_operation_kind::delete_batch},
+    {"lookup_and_delete_batch", map_operation_kind::lookup_and_delete_batch},
+};
+
+std::optional<map_operation_kind>
+map_operation_by_name(const std::string& name)
+{
+    auto kind = _map_operation_names.find(name);
+    if (kind == _map_operation_names.end()) {
+        return {};
+    }
+    return kind->second;
+}
+
+bool
+is_batch_map_operation(map_operation_kind kind)
+{
+    return kind == map_operation_kind::lookup_batch || kind == map_operation_kind::update_batch ||
+           kind == map_operation_kind::delete_batch || kind == map_operation_kind::lookup_and_delete_batch;
+}
+
+// Check whether an operation deletes the keys it cycles through, so that each key can only be used once.
+static bool
+_is_delete(map_operation_kind kind)
+{
+    return kind == map_operation_kind::delete_element || kind == map_operation_kind::lookup_and_delete ||
+           kind == map_operation_kind::delete_batch;
+}
+
+// Check whether an operation walks the map instead of cycling through the keys of the target.
+static bool
+_is_walk(map_operation_kind kind)
+{
+    return kind == map_operation_kind::get_next_key || kind == map_operation_kind::lookup_batch ||
+           kind == map_operation_kind::lookup_and_delete_batch;
+}
+
+map_operation_target::map_operation_target(bpf_map* map, int fd, size_t batch_size)
+{
+    this->name = bpf_map__name(map);
+    this->fd = fd;
+    this->key_size = bpf_map__key_size(map);
+    this->value_size = map_user_value_size(map);
+    this->batch_size = std::max<size_t>(batch_size, 1);
+    this->count = read_map_elements(
+        fd, this->name, this->key_size, this->value_size, bpf_map__max_entries(map), this->keys, this->values);
+}
+
+map_operation_worker::map_operation_worker(
+    std::shared_ptr<const map_operation_target> target,
+    map_operation_kind kind,
+    size_t worker_index,
+    size_t worker_count)
+    : target(target), kind(kind), walking(false)
+{
+    this->next_key = worker_count > 0 ? static_cast<size_t>(target->count) * worker_index / worker_count : 0;
+    this->end_key = worker_count > 0 ? static_cast<size_t>(target->count) * (worker_index + 1) / worker_count : 0;
+    // The batch position is opaque, but is never larger than the key or a 64-bit bucket index.
+    this->in_batch.resize(std::max(target->key_size, sizeof(uint64_t)));
+    this->out_batch.resize(this->in_batch.size());
+    // get_next_key keeps the previous and the next key.
+    this->keys.resize(std::max<size_t>(target->batch_size, 2) * target->key_size);
+    this->values.resize(target->batch_size * target->value_size);
+}
+
+int
+map_operation_worker::run(uint64_t element_count, uint64_t& processed)
+{
+    bpf_map_batch_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.sz = sizeof(opts);
+
+    auto& target = *this->target;
+    processed = 0;
+    if (!_is_walk(kind) && target.count == 0) {
+        return 0;
+    }
+    // Once a deleting worker has used up its keys, the others are deleting theirs. Going on would only time failures.
+    if (_is_delete(kind) && next_key >= end_key) {
+        return 0;
+    }
+
+    // Elements looked for since one was last found. Once a whole cycle through the keys finds nothing, or a walk
+    // finds the map empty, there is nothing left to process.
+    uint64_t missed = 0;
+    while (processed < element_count) {
+        const uint8_t* key = target.keys.data() + next_key * target.key_size;
+        const uint8_t* value = target.values.data() + next_key * target.value_size;
+        uint32_t attempted = 1;
+        uint32_t found = 0;
+        bool walk_started = walking;
+        int result = 0;
+
+        switch (kind) {
+        case map_operation_kind::lookup:
+            result = bpf_map_lookup_elem(target.fd, key, values.data());
+            break;
+        case map_operation_kind::update:
+            result = bpf_map_update_elem(target.fd, key, value, BPF_ANY);
+            break;
+        case map_operation_kind::delete_element:
+            result = bpf_map_delete_elem(target.fd, key);
+            break;
+        case map_operation_kind::lookup_and_delete:
+            result = bpf_map_lookup_and_delete_elem(target.fd, key, values.data());
+            break;
+        case map_operation_kind::get_next_key:
+            result = bpf_map_get_next_key(target.fd, walking ? keys.data() : nullptr, keys.data() + target.key_size);
+            if (result == 0) {
+                memcpy(keys.data(), keys.data() + target.key_size, target.key_size);
+            }
+            break;
+        case map_operation_kind::lookup_batch:
+        case map_operation_kind::lookup_and_delete_batch:
+            found = static_cast<uint32_t>(target.batch_size);
+            if (kind == map_operation_kind::lookup_batch) {
+                result = bpf_map_lookup_batch(
+                    target.fd,
+                    walking ? in_batch.data() : nullptr,
+                    out_batch.data(),
+                    keys.data(),
+                    values.data(),
+                    &found,
+                    &opts);
+            } else {
+                result = bpf_map_lookup_and_delete_batch(
+                    target.fd,
+                    walking ? in_batch.data() : nullptr,
+                    out_batch.data(),
+                    keys.data(),
+                    values.data(),
+                    &found,
+                    &opts);
+            }
+            in_batch = out_batch;
+            break;
+        case map_operation_kind::update_batch:
+        case map_operation_kind::delete_batch:
+            attempted = static_cast<uint32_t>(
+                std::min<size_t>(target.batch_size, (_is_delete(kind) ? end_key : target.count) - next_key));
+            found = attempted;
+            if (kind == map_operation_kind::update_batch) {
+                result = bpf_map_update_batch(
+                    target.fd, const_cast<uint8_t*>(key), const_cast<uint8_t*>(value), &found, &opts);
+            } else {
+                result = bpf_map_delete_batch(target.fd, const_cast<uint8_t*>(key), &found, &opts);
+            }
+            break;
+        }
+
+        // A missing element, or the end of a walk, is reported as ENOENT.
+        if (result < 0 && errno != ENOENT) {
+            return -errno;
+        }
+        if (!is_batch_map_operation(kind)) {
+            found = result == 0 ? 1 : 0;
+        }
+        processed += found;
+
+        if (_is_walk(kind)) {
+            walking = result == 0;
+            if (!walk_started && result < 0 && found == 0) {
+                break;
+            }
+            continue;
+        }
+
+        if (_is_delete(kind)) {
+            next_key += attempted;
+            if (next_key >= end_key) {
+                break;
+            }
+            continue;
+        }
+
+        next_key = (next_key + attempted) % target.count;
+        missed = found > 0 ? 0 : missed + attempted;
+        if (missed >= target.count) {
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <bpf/libbpf.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A map operation run from user space through the bpf() syscall, as the control plane of a BPF application
+ * does.
+ */
+enum class map_operation_kind
+{
+    lookup,
+    update,
+    delete_element,
+    lookup_and_delete,
+    get_next_key,
+    lookup_batch,
+    update_batch,
+    delete_batch,
+    lookup_and_delete_batch,
+};
+
+/**
+ * @brief Get the operation with the given name: lookup, update, delete, lookup_and_delete, get_next_key, lookup_batch,
+ * update_batch, delete_batch or lookup_and_delete_batch.
+ *
+ * @return The operation, or no value if the name is unknown.
+ */
+std::optional<map_operation_kind>
+map_operation_by_name(const std::string& name);
+
+/**
+ * @brief Check whether an operation processes batch_size elements per call.
+ */
+bool
+is_batch_map_operation(map_operation_kind kind);
+
+/**
+ * @brief The map that map operations run against, and the elements it held before the test started.
+ *
+ * Operations on single elements and update_batch and delete_batch cycle through the keys of these elements, so that
+ * lookups and updates find the elements of a populated map. delete, lookup_and_delete and delete_batch instead split
+ * the keys between the workers and stop at the end of their share, as every key can only be deleted once.
+ * lookup_batch, lookup_and_delete_batch and get_next_key walk the map itself, starting over at its end.
+ */
+struct map_operation_target
+{
+    /**
+     * @brief Read the current elements of a map.
+     *
+     * @param[in] map The map.
+     * @param[in] fd File descriptor to access the map through.
+     * @param[in] batch_size Number of elements per call of the batch operations.
+     */
+    map_operation_target(bpf_map* map, int fd, size_t batch_size);
+
+    std::string name;
+    int fd;
+    size_t key_size;
+    // Size of the value of one element as read and written from user space, covering all CPUs of per-CPU maps.
+    size_t value_size;
+    size_t batch_size;
+    uint32_t count;
+    std::vector<uint8_t> keys;
+    std::vector<uint8_t> values;
+};
+
+/**
+ * @brief Runs one kind of map operation on the calling thread, with buffers of its own.
+ */
+class map_operation_worker
+{
+  public:
+    /**
+     * @brief Prepare to run an operation.
+     *
+     * @param[in] target The map to run the operation against.
+     * @param[in] kind The operation.
+     * @param[in] worker_index Index of this worker among the workers of the test, which start at different keys, or
+     * for deleting operations, use keys of their own.
+     * @param[in] worker_count Number of workers of the test.
+     */
+    map_operation_worker(
+        std::shared_ptr<const map_operation_target> target,
+        map_operation_kind kind,
+        size_t worker_index,
+        size_t worker_count);
+
+    /**
+     * @brief Run the operation until at least element_count elements have been processed, or until the operation finds
+     * no elements left, as happens once deleting operations have used up their keys or emptied the map.
+     *
+     * Elements that are not found are not counted, but are not an error either.
+     *
+     * @param[in] element_count Number of elements to process.
+     * @param[out] processed Number of elements processed.
+     * @return 0 on success, or a negative error number if an operation failed.
+     */
+    int
+    run(uint64_t element_count, uint64_t& processed);
+
+  private:
+    std::shared_ptr<const map_operation_target> target;
+    map_operation_kind kind;
+    // Index of the next key of the target to use, and for deleting operations, the end of this worker's keys.
+    size_t next_key;
+    size_t end_key;
+    // Whether a walk of the map is in progress, and its position.
+    bool walking;
+    std::vector<uint8_t> in_batch;
+    std::vector<uint8_t> out_batch;
+    std::vector<uint8_t> keys;
+    std::vector<uint8_t> values;
+};
@@ -0,0 +1,558 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "map_population.h"
+
+#include <algorithm>
+#include <bit>
+#include <bpf/bpf.h>
+#include <bpf/btf.h>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+// Largest number of values a zipf generator, or a scrambled generator, can draw from. Each value takes 8 bytes of
+// memory while the map is populated.
+#define MAX_DISTRIBUTION_VALUES (1ull << 24)
+
+// Location of an integer field within a key or value.
+struct field_layout
+{
+    size_t offset;
+    size_t size;
+};
+
+static field_generator::generator_kind
+_parse_generator_kind(const std::string& name)
+{
+    if (name == "constant") {
+        return field_generator::generator_kind::constant;
+    } else if (name == "sequential") {
+        return field_generator::generator_kind::sequential;
+    } else if (name == "random") {
+        return field_generator::generator_kind::random;
+    } else if (name == "file") {
+        return field_generator::generator_kind::file;
+    } else if (name == "zipf") {
+        return field_generator::generator_kind::zipf;
+    } else if (name == "hot_set") {
+        return field_generator::generator_kind::hot_set;
+    } else if (name == "weighted") {
+        return field_generator::generator_kind::weighted;
+    }
+    throw std::runtime_error("Unknown map_population generator " + name);
+}
+
+// A generator is either the name of a generator, using its defaults, or a map with a generator field and its settings.
+static field_generator
+_parse_field_generator(const std::string& field, const YAML::Node& node)
+{
+    field_generator generator;
+    generator.field = field;
+
+    if (node.IsScalar()) {
+        generator.kind = _parse_generator_kind(node.as<std::string>());
+    } else {
+        generator.kind = _parse_generator_kind(node["generator"].as<std::string>());
+        if (node["value"].IsDefined()) {
+            generator.value = node["value"].as<uint64_t>();
+        }
+        if (node["start"].IsDefined()) {
+            generator.start = node["start"].as<uint64_t>();
+        }
+        if (node["step"].IsDefined()) {
+            generator.step = node["step"].as<uint64_t>();
+        }
+        if (node["min"].IsDefined()) {
+            generator.min = node["min"].as<uint64_t>();
+        }
+        if (node["max"].IsDefined()) {
+            generator.max = node["max"].as<uint64_t>();
+        }
+        if (node["seed"].IsDefined()) {
+            generator.seed = node["seed"].as<uint64_t>();
+        }
+        if (node["theta"].IsDefined()) {
+            generator.theta = node["theta"].as<double>();
+        }
+        if (node["hot_percent"].IsDefined()) {
+            generator.hot_percent = node["hot_percent"].as<double>();
+        }
+        if (node["hot_access_percent"].IsDefined()) {
+            generator.hot_access_percent = node["hot_access_percent"].as<double>();
+        }
+        if (node["scramble"].IsDefined()) {
+            generator.scramble = node["scramble"].as<bool>();
+        }
+        if (node["quantiles"].IsDefined()) {
+            generator.quantiles = node["quantiles"].as<bool>();
+        }
+        if (node["network_byte_order"].IsDefined()) {
+            generator.network_byte_order = node["network_byte_order"].as<bool>();
+        }
+        if (node["prefix_length_field"].IsDefined()) {
+            generator.prefix_length_field = node["prefix_length_field"].as<std::string>();
+        }
+        if (node["weights"].IsDefined()) {
+            if (!node["weights"].IsMap()) {
+                throw std::runtime_error(
+                    "map_population weighted generator weights must be a map of values to weights");
+            }
+            for (auto weight : node["weights"]) {
+                generator.weighted_values.push_back(weight.first.as<uint64_t>());
+                generator.weights.push_back(weight.second.as<double>());
+            }
+        }
+        if (node["path"].IsDefined()) {
+            std::string path = node["path"].as<std::string>();
+            std::ifstream stream(path);
+            if (!stream) {
+                throw std::runtime_error("Failed to open map_population file " + path);
+            }
+            // One value per line, in decimal or with a 0x prefix in hexadecimal.
+            std::string line;
+            while (std::getline(stream, line)) {
+                if (!line.empty()) {
+                    generator.file_values.push_back(std::stoull(line, nullptr, 0));
+                }
+            }
+        }
+    }
+
+    bool skewed = generator.kind == field_generator::generator_kind::zipf ||
+                  generator.kind == field_generator::generator_kind::hot_set;
+    if (generator.kind == field_generator::generator_kind::random && generator.min > generator.max) {
+        throw std::runtime_error("map_population random generator min must not be greater than max");
+    }
+    if (generator.scramble && !skewed) {
+        throw std::runtime_error("map_population scramble is only supported by zipf and hot_set generators");
+    }
+    if (generator.quantiles && !skewed) {
+        throw std::runtime_error("map_population quantiles is only supported by zipf and hot_set generators");
+    }
+    if (generator.quantiles && generator.scramble) {
+        // The ranks between two quantiles are only contiguous in rank order.
+        throw std::runtime_error("map_population quantiles cannot be combined with scramble");
+    }
+    if (skewed && generator.min > generator.max) {
+        throw std::runtime_error("map_population zipf and hot_set generator min must not be greater than max");
+    }
+    if (skewed && (generator.max == std::numeric_limits<uint64_t>::max() ||
+                   ((generator.kind == field_generator::generator_kind::zipf || generator.scramble) &&
+                    generator.max - generator.min >= MAX_DISTRIBUTION_VALUES))) {
+        throw std::runtime_error(
+            "map_population zipf and hot_set generators require a max with at most " +
+            std::to_string(MAX_DISTRIBUTION_VALUES) + " values between min and max");
+    }
+    if (generator.kind == field_generator::generator_kind::zipf && !(generator.theta > 0)) {
+        throw std::runtime_error("map_population zipf generator theta must be greater than zero");
+    }
+    if (generator.kind == field_generator::generator_kind::hot_set &&
+        (!(generator.hot_percent > 0 && generator.hot_percent <= 100) ||
+         !(generator.hot_access_percent >= 0 && generator.hot_access_percent <= 100))) {
+        throw std::runtime_error(
+            "map_population hot_set generator hot_percent and hot_access_percent must be between 0 and 100");
+    }
+    auto& weights = generator.weights;
+    if (generator.kind == field_generator::generator_kind::weighted &&
+        (weights.empty() || std::any_of(weights.begin(), weights.end(), [](double weight) { return !(weight >= 0); }) ||
+         !(std::accumulate(weights.begin(), weights.end(), 0.0) > 0))) {
+        throw std::runtime_error(
+            "map_population weighted generator requires weights that are not negative and not all zero");
+    }
+    if (generator.kind == field_generator::generator_kind::file && generator.file_values.empty()) {
+        throw std::runtime_error("map_population file generator requires a path with at least one value");
+    }
+    return generator;
+}
+
+// The key or value is either a single generator for the whole key or value, or a map of field names to generators.
+static std::vector<field_generator>
+_parse_field_generators(const YAML::Node& node)
+{
+    std::vector<field_generator> generators;
+    if (!node.IsDefined()) {
+        return generators;
+    }
+    if (node.IsScalar() || node["generator"].IsDefined()) {
+        generators.push_back(_parse_field_generator("", node));
+    } else if (node.IsMap()) {
+        for (auto field : node) {
+            generators.push_back(_parse_field_generator(field.first.as<std::string>(), field.second));
+        }
+    } else {
+        throw std::runtime_error("Invalid map_population generator - must be string or map");
+    }
+
+    for (auto& generator : generators) {
+        if (generator.prefix_length_field.empty()) {
+            continue;
+        }
+        if (generator.prefix_length_field == generator.field ||
+            std::none_of(generators.begin(), generators.end(), [&generator](const field_generator& other) {
+                return other.field == generator.prefix_length_field;
+            })) {
+            throw std::runtime_error(
+                "map_population prefix_length_field " + generator.prefix_length_field +
+                " must be another generated field of the same key or value");
+        }
+    }
+    return generators;
+}
+
+map_population
+parse_map_population(const YAML::Node& node)
+{
+    if (!node["map"].IsDefined()) {
+        throw std::runtime_error("Field map_population.map is required");
+    }
+
+    if (!node["count"].IsDefined()) {
+        throw std::runtime_error("Field map_population.count is required");
+    }
+
+    if (!node["key"].IsDefined()) {
+        throw std::runtime_error("Field map_population.key is required");
+    }
+
+    map_population population;
+    population.map_name = node["map"].as<std::string>();
+    population.count = node["count"].as<uint32_t>();
+    population.key_fields = _parse_field_generators(node["key"]);
+    population.value_fields = _parse_field_generators(node["value"]);
+
+    if (population.count < 1) {
+        throw std::runtime_error("Field map_population.count must be greater than zero");
+    }
+
+    for (auto* fields : {&population.key_fields, &population.value_fields}) {
+        for (auto& generator : *fields) {
+            if (generator.kind == field_generator::generator_kind::file &&
+                generator.file_values.size() < population.count) {
+                throw std::runtime_error(
+                    "map_population file for map " + population.map_name + " has fewer than " +
+                    std::to_string(population.count) + " values");
+            }
+        }
+    }
+
+    return population;
+}
+
+// Find the offset and size of a field, given as a dotted path of member names, in a BTF type.
+static field_layout
+_resolve_field(const btf* btf, uint32_t type_id, const std::string& field, const std::string& map_name)
+{
+    size_t offset = 0;
+    std::string remaining = field;
+    while (!remaining.empty()) {
+        size_t separator = remaining.find('.');
+        std::string member_name = remaining.substr(0, separator);
+        remaining = separator == std::string::npos ? "" : remaining.substr(separator + 1);
+
+        const btf_type* type = btf__type_by_id(btf, btf__resolve_type(btf, type_id));
+        if (!type || (btf_kind(type) != BTF_KIND_STRUCT && btf_kind(type) != BTF_KIND_UNION)) {
+            throw std::runtime_error("Field " + field + " of map " + map_name + " is not in a struct");
+        }
+
+        const btf_member* member = btf_members(type);
+        uint16_t member_index = 0;
+        for (; member_index < btf_vlen(type); member_index++, member++) {
+            if (member_name == btf__name_by_offset(btf, member->name_off)) {
+                break;
+            }
+        }
+        if (member_index == btf_vlen(type)) {
+            throw std::runtime_error("Field " + field + " not found in map " + map_name);
+        }
+
+        uint32_t bit_offset = btf_member_bit_offset(type, member_index);
+        if (bit_offset % 8 != 0) {
+            throw std::runtime_error("Field " + field + " of map " + map_name + " is a bit field");
+        }
+        offset += bit_offset / 8;
+        type_id = member->type;
+    }
+
+    const btf_type* type = btf__type_by_id(btf, btf__resolve_type(btf, type_id));
+    if (!type || (btf_kind(type) != BTF_KIND_INT && btf_kind(type) != BTF_KIND_ENUM)) {
+        std::string description = field.empty() ? "Key or value" : "Field " + field;
+        throw std::runtime_error(description + " of map " + map_name + " is not an integer");
+    }
+    return {offset, static_cast<size_t>(btf__resolve_size(btf, type_id))};
+}
+
+// Resolve the layout of each generator's field, falling back to a single integer when the map has no BTF.
+static std::vector<field_layout>
+_resolve_fields(
+    const btf* btf,
+    uint32_t type_id,
+    size_t size,
+    const std::vector<field_generator>& generators,
+    const std::string& map_name)
+{
+    std::vector<field_layout> layouts;
+    for (auto& generator : generators) {
+        if (btf && type_id) {
+            layouts.push_back(_resolve_field(btf, type_id, generator.field, map_name));
+        } else if (generator.field.empty() && size <= sizeof(uint64_t)) {
+            layouts.push_back({0, size});
+        } else {
+            throw std::runtime_error("Map " + map_name + " has no BTF to resolve its fields from");
+        }
+    }
+    return layouts;
+}
+
+// Produces successive values of a field generator.
+class field_value_source
+{
+  public:
+    field_value_source(const field_generator& generator, size_t size, uint32_t element_count)
+        : generator(generator), element_count(element_count), random(generator.seed),
+          distribution(
+              std::min(generator.min, _max_for_size(size)), std::min(generator.max, _max_for_size(size)))
+    {
+        // The zipf and hot_set generators draw a rank in [0, count) and map it to a value in [min, max].
+        count = distribution.b() - distribution.a() + 1;
+        if (generator.kind == field_generator::generator_kind::zipf) {
+            // Cumulative probability of each rank, searched with a uniformly distributed draw.
+            cumulative_probabilities.resize(count);
+            double total = 0;
+            for (uint64_t rank = 0; rank < count; rank++) {
+                total += 1 / std::pow(static_cast<double>(rank + 1), generator.theta);
+                cumulative_probabilities[rank] = total;
+            }
+            for (auto& probability : cumulative_probabilities) {
+                probability /= total;
+            }
+        } else if (generator.kind == field_generator::generator_kind::hot_set) {
+            hot_count = std::clamp<uint64_t>(
+                static_cast<uint64_t>(std::llround(count * generator.hot_percent / 100)), 1, count);
+            hot_distribution = std::uniform_int_distribution<uint64_t>(0, hot_count - 1);
+            cold_distribution = std::uniform_int_distribution<uint64_t>(std::min(hot_count, count - 1), count - 1);
+        } else if (generator.kind == field_generator::generator_kind::weighted) {
+            weighted_distribution =
+                std::discrete_distribution<size_t>(generator.weights.begin(), generator.weights.end());
+        }
+        bool skewed = generator.kind == field_generator::generator_kind::zipf ||
+                      generator.kind == field_generator::generator_kind::hot_set;
+        if (generator.scramble && skewed) {
+            rank_values.resize(count);
+            std::iota(rank_values.begin(), rank_values.end(), 0);
+            std::shuffle(rank_values.begin(), rank_values.end(), random);
+        }
+    }
+
+    uint64_t
+    operator()(uint32_t index)
+    {
+        switch (generator.kind) {
+        case field_generator::generator_kind::constant:
+            return generator.value;
+        case field_generator::generator_kind::sequential:
+            return generator.start + index * generator.step;
+        case field_generator::generator_kind::random:
+            return distribution(random);
+        case field_generator::generator_kind::file:
+            return generator.file_values[index];
+        case field_generator::generator_kind::zipf: {
+            if (generator.quantiles) {
+                // The rank whose share of the cumulative probability holds the quantile.
+                auto rank = std::upper_bound(
+                                cumulative_probabilities.begin(), cumulative_probabilities.end(), _quantile(index)) -
+                            cumulative_probabilities.begin();
+                return _rank_to_value(std::min<uint64_t>(rank, count - 1));
+            }
+            auto rank = std::lower_bound(
+                            cumulative_probabilities.begin(), cumulative_probabilities.end(), probability(random)) -
+                        cumulative_probabilities.begin();
+            return _rank_to_value(std::min<uint64_t>(rank, cumulative_probabilities.size() - 1));
+        }
+        case field_generator::generator_kind::hot_set:
+            if (generator.quantiles) {
+                // The hot ranks take the first hot_access_percent of the quantiles, and the cold ranks the rest.
+                double quantile = _quantile(index);
+                double hot_share = hot_count == count ? 1 : generator.hot_access_percent / 100;
+                uint64_t rank = quantile < hot_share
+                                    ? static_cast<uint64_t>(quantile / hot_share * hot_count)
+                                    : hot_count + static_cast<uint64_t>(
+                                                      (quantile - hot_share) / (1 - hot_share) * (count - hot_count));
+                return _rank_to_value(std::min<uint64_t>(rank, count - 1));
+            }
+            if (probability(random) * 100 < generator.hot_access_percent || hot_count == count) {
+                return _rank_to_value(hot_distribution(random));
+            }
+            return _rank_to_value(cold_distribution(random));
+        case field_generator::generator_kind::weighted:
+            return generator.weighted_values[weighted_distribution(random)];
+        }
+        return 0;
+    }
+
+  private:
+    static uint64_t
+    _max_for_size(size_t size)
+    {
+        return size >= sizeof(uint64_t) ? std::numeric_limits<uint64_t>::max() : (1ull << (size * 8)) - 1;
+    }
+
+    double
+    _quantile(uint32_t index) const
+    {
+        return static_cast<double>(index) / element_count;
+    }
+
+    uint64_t
+    _rank_to_value(uint64_t rank) const
+    {
+        return distribution.a() + (rank_values.empty() ? rank : rank_values[rank]);
+    }
+
+    const field_generator& generator;
+    // Number of elements written to the map.
+    uint32_t element_count;
+    std::mt19937_64 random;
+    std::uniform_int_distribution<uint64_t> distribution;
+    std::uniform_real_distribution<double> probability;
+    // Number of values in [min, max].
+    uint64_t count = 0;
+    std::vector<double> cumulative_probabilities;
+    uint64_t hot_count = 0;
+    std::uniform_int_distribution<uint64_t> hot_distribution;
+    std::uniform_int_distribution<uint64_t> cold_distribution;
+    std::discrete_distribution<size_t> weighted_distribution;
+    // Value offset of each rank when scrambled.
+    std::vector<uint64_t> rank_values;
+};
+
+// Store the low layout.size bytes of value into buffer at layout.offset.
+static void
+_store_field(uint8_t* buffer, const field_layout& layout, uint64_t value, bool network_byte_order)
+{
+    bool big_endian = network_byte_order || std::endian::native == std::endian::big;
+    for (size_t i = 0; i < layout.size; i++) {
+        size_t shift = 8 * (big_endian ? layout.size - 1 - i : i);
+        buffer[layout.offset + i] = shift < 64 ? static_cast<uint8_t>(value >> shift) : 0;
+    }
+}
+
+// Keep the leading prefix_length bits of a field of size bytes.
+static uint64_t
+_keep_prefix(uint64_t value, uint64_t prefix_length, size_t size)
+{
+    uint64_t bits = std::min<uint64_t>(size * 8, 64);
+    if (prefix_length >= bits) {
+        return value;
+    }
+    return prefix_length == 0 ? 0 : value & (~0ull << (bits - prefix_length));
+}
+
+// Generate the fields of the key or value of one element and store them into buffer.
+static void
+_store_fields(
+    uint8_t* buffer,
+    const std::vector<field_generator>& generators,
+    const std::vector<field_layout>& layouts,
+    std::vector<field_value_source>& sources,
+    uint32_t index)
+{
+    std::vector<uint64_t> field_values(sources.size());
+    for (size_t i = 0; i < sources.size(); i++) {
+        field_values[i] = sources[i](index);
+    }
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (!generators[i].prefix_length_field.empty()) {
+            size_t prefix_length_index = std::find_if(
+                                             generators.begin(),
+                                             generators.end(),
+                                             [&generator = generators[i]](const field_generator& other) {
+                                                 return other.field == generator.prefix_length_field;
+                                             }) -
+                                         generators.begin();
+            field_values[i] = _keep_prefix(field_values[i], field_values[prefix_length_index], layouts[i].size);
+        }
+        _store_field(buffer, layouts[i], field_values[i], generators[i].network_byte_order);
+    }
+}
+
+static bool
+_is_per_cpu_map(bpf_map_type type)
+{
+    return type == BPF_MAP_TYPE_PERCPU_ARRAY || type == BPF_MAP_TYPE_PERCPU_HASH ||
+           type == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+}
+
+void
+populate_map(bpf_object* obj, int map_fd, const map_population& population)
+{
+    bpf_map* map = bpf_object__find_map_by_name(obj, population.map_name.c_str());
+    if (!map) {
+        throw std::runtime_error("Failed to find map " + population.map_name);
+    }
+
+    const btf* btf = bpf_object__btf(obj);
+    size_t key_size = bpf_map__key_size(map);
+    size_t value_size = bpf_map__value_size(map);
+    auto key_layouts =
+        _resolve_fields(btf, bpf_map__btf_key_type_id(map), key_size, population.key_fields, population.map_name);
+    auto value_layouts = _resolve_fields(
+        btf, bpf_map__btf_value_type_id(map), value_size, population.value_fields, population.map_name);
+
+    // Per-CPU maps take one 8-byte aligned value per possible CPU, each initialized the same way.
+    size_t value_copies = 1;
+    size_t value_stride = value_size;
+    if (_is_per_cpu_map(bpf_map__type(map))) {
+        value_copies = libbpf_num_possible_cpus();
+        value_stride = (value_size + 7) & ~static_cast<size_t>(7);
+    }
+
+    std::vector<field_value_source> key_sources;
+    for (size_t i = 0; i < population.key_fields.size(); i++) {
+        key_sources.emplace_back(population.key_fields[i], key_layouts[i].size, population.count);
+    }
+    std::vector<field_value_source> value_sources;
+    for (size_t i = 0; i < population.value_fields.size(); i++) {
+        value_sources.emplace_back(population.value_fields[i], value_layouts[i].size, population.count);
+    }
+
+    std::vector<uint8_t> keys(population.count * key_size);
+    std::vector<uint8_t> values(population.count * value_stride * value_copies);
+    for (uint32_t index = 0; index < population.count; index++) {
+        uint8_t* key = keys.data() + index * key_size;
+        _store_fields(key, population.key_fields, key_layouts, key_sources, index);
+
+        uint8_t* value = values.data() + index * value_stride * value_copies;
+        _store_fields(value, population.value_fields, value_layouts, value_sources, index);
+        for (size_t copy = 1; copy < value_copies; copy++) {
+            memcpy(value + copy * value_stride, value, value_stride);
+        }
+    }
+
+    bpf_map_batch_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.sz = sizeof(opts);
+    opts.elem_flags = BPF_ANY;
+
+    uint32_t count = population.count;
+    if (bpf_map_update_batch(map_fd, keys.data(), values.data(), &count, &opts) == 0) {
+        return;
+    }
+
+    // Not every map type supports batch operations. Fall back to single updates, which also identifies the element
+    // that failed if the batch failed for another reason.
+    for (uint32_t index = 0; index < population.count; index++) {
+        if (bpf_map_update_elem(
+                map_fd,
+                keys.data() + index * key_size,
+                values.data() + index * value_stride * value_copies,
+                BPF_ANY) < 0) {
+            throw std::runtime_error(
+                "Failed to populate map " + population.map_name + " element " + std::to_string(index) + ": " +
+                strerror(errno));
+        }
+    }
+}
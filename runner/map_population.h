@@ -0,0 +1,95 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <bpf/libbpf.h>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+
+/**
+ * @brief Generates the values of one integer field of the keys or values written to a map.
+ */
+struct field_generator
+{
+    enum class generator_kind
+    {
+        constant,
+        sequential,
+        random,
+        file,
+        zipf,
+        hot_set,
+        weighted,
+    };
+
+    // Dotted path of the field within the key or value, or empty for the whole key or value.
+    std::string field;
+    generator_kind kind = generator_kind::sequential;
+    // constant: the value of every element.
+    uint64_t value = 0;
+    // sequential: element i gets start + i * step.
+    uint64_t start = 0;
+    uint64_t step = 1;
+    // random: uniformly distributed in [min, max], reproducible for a given seed.
+    uint64_t min = 0;
+    uint64_t max = std::numeric_limits<uint64_t>::max();
+    uint64_t seed = 0;
+    // zipf: value min + k is drawn with probability proportional to 1 / (k + 1)^theta.
+    double theta = 0.99;
+    // hot_set: hot_access_percent of the values are drawn uniformly from the first hot_percent of [min, max], and the
+    // rest uniformly from the remainder.
+    double hot_percent = 20;
+    double hot_access_percent = 80;
+    // zipf and hot_set: spread the popular values over [min, max] in a random order instead of placing them first.
+    bool scramble = false;
+    // zipf and hot_set: instead of drawing values, element i of count gets the value at quantile i / count, so that
+    // the elements form a table of the inverse CDF of the distribution.
+    bool quantiles = false;
+    // file: element i gets the i-th value read from the file.
+    std::vector<uint64_t> file_values;
+    // weighted: each value is drawn with probability proportional to its weight, reproducible for a given seed.
+    std::vector<uint64_t> weighted_values;
+    std::vector<double> weights;
+    // Keep only as many leading bits of the field as the value of this other field of the same key or value, as for
+    // the address of a route with its prefix length.
+    std::string prefix_length_field;
+    // Store the field most significant byte first, as for addresses and ports.
+    bool network_byte_order = false;
+};
+
+/**
+ * @brief A set of elements to write to a map before a test runs.
+ */
+struct map_population
+{
+    std::string map_name;
+    uint32_t count = 0;
+    std::vector<field_generator> key_fields;
+    std::vector<field_generator> value_fields;
+};
+
+/**
+ * @brief Parse and validate one entry of a test's map_population sequence.
+ *
+ * @param[in] node The YAML node of the entry.
+ * @return The parsed entry. Values for file generators are read from their files.
+ */
+map_population
+parse_map_population(const YAML::Node& node);
+
+/**
+ * @brief Write the elements described by a map_population entry to a map using batch updates.
+ *
+ * The layout of the keys and values is taken from the map's BTF, so generators can name the fields of struct keys
+ * and values. Maps without BTF are treated as a single integer key and value.
+ *
+ * @param[in] obj The BPF object holding the map. It only needs to be opened.
+ * @param[in] map_fd File descriptor of the map.
+ * @param[in] population The elements to write.
+ */
+void
+populate_map(bpf_object* obj, int map_fd, const map_population& population);
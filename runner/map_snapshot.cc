@@ -0,0 +1,200 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "map_snapshot.h"
+
+#include <algorithm>
+#include <bpf/bpf.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+static bool
+_is_hash_map(bpf_map_type type)
+{
+    return type == BPF_MAP_TYPE_HASH || type == BPF_MAP_TYPE_PERCPU_HASH || type == BPF_MAP_TYPE_LRU_HASH ||
+           type == BPF_MAP_TYPE_LRU_PERCPU_HASH || type == BPF_MAP_TYPE_LPM_TRIE;
+}
+
+static bool
+_is_array_map(bpf_map_type type)
+{
+    return type == BPF_MAP_TYPE_ARRAY || type == BPF_MAP_TYPE_PERCPU_ARRAY;
+}
+
+static bool
+_is_per_cpu_map(bpf_map_type type)
+{
+    return type == BPF_MAP_TYPE_PERCPU_ARRAY || type == BPF_MAP_TYPE_PERCPU_HASH ||
+           type == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+}
+
+static std::runtime_error
+_map_error(const std::string& action, const std::string& name)
+{
+    return std::runtime_error("Failed to " + action + " map " + name + ": " + strerror(errno));
+}
+
+size_t
+map_user_value_size(bpf_map* map)
+{
+    size_t value_size = bpf_map__value_size(map);
+    if (_is_per_cpu_map(bpf_map__type(map))) {
+        // Per-CPU values are read as one 8-byte aligned value per possible CPU.
+        value_size = ((value_size + 7) & ~static_cast<size_t>(7)) * libbpf_num_possible_cpus();
+    }
+    return value_size;
+}
+
+uint32_t
+read_map_elements(
+    int fd,
+    const std::string& name,
+    size_t key_size,
+    size_t value_size,
+    uint32_t max_entries,
+    std::vector<uint8_t>& keys,
+    std::vector<uint8_t>& values)
+{
+    keys.resize(static_cast<size_t>(max_entries) * key_size);
+    values.resize(static_cast<size_t>(max_entries) * value_size);
+
+    bpf_map_batch_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.sz = sizeof(opts);
+
+    // The batch position is opaque, but is never larger than the key or a 64-bit bucket index.
+    std::vector<uint8_t> in_batch(std::max(key_size, sizeof(uint64_t)));
+    std::vector<uint8_t> out_batch(in_batch.size());
+    uint32_t total = 0;
+    bool batch_supported = true;
+    while (total < max_entries) {
+        uint32_t count = max_entries - total;
+        int result = bpf_map_lookup_batch(
+            fd,
+            total == 0 ? nullptr : in_batch.data(),
+            out_batch.data(),
+            keys.data() + total * key_size,
+            values.data() + total * value_size,
+            &count,
+            &opts);
+        if (result < 0 && errno != ENOENT) {
+            if (total == 0) {
+                batch_supported = false;
+                break;
+            }
+            throw _map_error("read", name);
+        }
+        total += count;
+        if (result < 0 || count == 0) {
+            // ENOENT marks the end of the map.
+            break;
+        }
+        in_batch = out_batch;
+    }
+
+    if (!batch_supported) {
+        // Walk the keys one at a time for map types without batch support.
+        total = 0;
+        while (total < max_entries &&
+               bpf_map_get_next_key(
+                   fd, total == 0 ? nullptr : keys.data() + (total - 1) * key_size, keys.data() + total * key_size) ==
+                   0) {
+            if (bpf_map_lookup_elem(fd, keys.data() + total * key_size, values.data() + total * value_size) < 0) {
+                throw _map_error("read", name);
+            }
+            total++;
+        }
+    }
+
+    keys.resize(static_cast<size_t>(total) * key_size);
+    values.resize(static_cast<size_t>(total) * value_size);
+    return total;
+}
+
+map_snapshot::map_snapshot(const std::vector<std::pair<bpf_map*, int>>& maps)
+{
+    for (auto& [map, fd] : maps) {
+        bpf_map_type type = bpf_map__type(map);
+        if (!_is_hash_map(type) && !_is_array_map(type)) {
+            continue;
+        }
+#if defined(__linux__)
+        // .rodata is frozen at load and cannot change. BPF_F_RDONLY_PROG is an enumerator, so it can't be tested for
+        // with the preprocessor.
+        if (bpf_map__map_flags(map) & BPF_F_RDONLY_PROG) {
+            continue;
+        }
+#endif
+
+        map_contents contents;
+        contents.name = bpf_map__name(map);
+        contents.fd = fd;
+        contents.type = type;
+        contents.key_size = bpf_map__key_size(map);
+        contents.value_size = map_user_value_size(map);
+        contents.max_entries = bpf_map__max_entries(map);
+        contents.count = read_map_elements(
+            fd,
+            contents.name,
+            contents.key_size,
+            contents.value_size,
+            contents.max_entries,
+            contents.keys,
+            contents.values);
+        this->maps.push_back(std::move(contents));
+    }
+}
+
+void
+map_snapshot::restore() const
+{
+    bpf_map_batch_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.sz = sizeof(opts);
+
+    for (auto& contents : maps) {
+        // Array elements always exist and are simply overwritten. Other maps are emptied first, so that elements
+        // added since the snapshot do not remain.
+        if (_is_hash_map(contents.type)) {
+            std::vector<uint8_t> keys;
+            std::vector<uint8_t> values;
+            uint32_t current_count = read_map_elements(
+                contents.fd,
+                contents.name,
+                contents.key_size,
+                contents.value_size,
+                contents.max_entries,
+                keys,
+                values);
+            uint32_t count = current_count;
+            if (current_count > 0 && bpf_map_delete_batch(contents.fd, keys.data(), &count, &opts) < 0) {
+                for (uint32_t i = 0; i < current_count; i++) {
+                    if (bpf_map_delete_elem(contents.fd, keys.data() + i * contents.key_size) < 0 &&
+                        errno != ENOENT) {
+                        throw _map_error("clear", contents.name);
+                    }
+                }
+            }
+        }
+
+        uint32_t count = contents.count;
+        if (count > 0 &&
+            bpf_map_update_batch(
+                contents.fd,
+                const_cast<uint8_t*>(contents.keys.data()),
+                const_cast<uint8_t*>(contents.values.data()),
+                &count,
+                &opts) < 0) {
+            for (uint32_t i = 0; i < contents.count; i++) {
+                if (bpf_map_update_elem(
+                        contents.fd,
+                        contents.keys.data() + i * contents.key_size,
+                        contents.values.data() + i * contents.value_size,
+                        BPF_ANY) < 0) {
+                    throw _map_error("restore", contents.name);
+                }
+            }
+        }
+    }
+}
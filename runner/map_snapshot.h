@@ -0,0 +1,82 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <bpf/libbpf.h>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Get the size of the value of one element of a map as read and written from user space, which covers all CPUs
+ * of per-CPU maps.
+ */
+size_t
+map_user_value_size(bpf_map* map);
+
+/**
+ * @brief Read every element of a map, using batch lookups when the map type supports them.
+ *
+ * @param[in] fd File descriptor of the map.
+ * @param[in] name Name of the map, for error messages.
+ * @param[in] key_size Size of a key.
+ * @param[in] value_size Size of a value as returned by map_user_value_size.
+ * @param[in] max_entries Maximum number of elements of the map.
+ * @param[out] keys The keys of the elements.
+ * @param[out] values The values of the elements.
+ * @return The number of elements read.
+ */
+uint32_t
+read_map_elements(
+    int fd,
+    const std::string& name,
+    size_t key_size,
+    size_t value_size,
+    uint32_t max_entries,
+    std::vector<uint8_t>& keys,
+    std::vector<uint8_t>& values);
+
+/**
+ * @brief A copy of the contents of the data maps of a BPF object, which can be written back to undo changes made by
+ * the programs under test.
+ *
+ * Only hash, LRU hash, LPM trie and array maps, including their per-CPU variants, are captured. Program arrays and
+ * map-in-maps hold references set up at load, and frozen read-only maps cannot change.
+ */
+class map_snapshot
+{
+  public:
+    map_snapshot() = default;
+
+    /**
+     * @brief Capture the contents of the given maps.
+     *
+     * @param[in] maps Each map with the file descriptor to read it through.
+     */
+    map_snapshot(const std::vector<std::pair<bpf_map*, int>>& maps);
+
+    /**
+     * @brief Restore every captured map to its captured contents, deleting any elements added since.
+     */
+    void
+    restore() const;
+
+  private:
+    struct map_contents
+    {
+        std::string name;
+        int fd;
+        bpf_map_type type;
+        size_t key_size;
+        // Size of the value of one element as read and written from user space, covering all CPUs of per-CPU maps.
+        size_t value_size;
+        uint32_t max_entries;
+        uint32_t count;
+        std::vector<uint8_t> keys;
+        std::vector<uint8_t> values;
+    };
+
+    std::vector<map_contents> maps;
+};
@@ -0,0 +1,776 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "output.h"
+
+#include <cmath>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+// Format a duration in nanoseconds as an integer, matching the integer durations reported by the kernel.
+static std::string
+_format_nanoseconds(double value)
+{
+    return std::to_string(std::llround(value));
+}
+
+// Format a value that is usually fractional, such as a count per operation.
+static std::string
+_format_fraction(double value)
+{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(3) << value;
+    return ss.str();
+}
+
+// Get a counter per operation, if it was recorded.
+static std::optional<double>
+_perf_counter_per_operation(const test_result& result, perf_counter counter)
+{
+    if (!result.perf_counters.has_value() || !(*result.perf_counters)[counter].has_value() ||
+        result.perf_counter_operations == 0) {
+        return {};
+    }
+    return static_cast<double>((*result.perf_counters)[counter].value()) / result.perf_counter_operations;
+}
+
+// Get the instructions per cycle, if both counters were recorded.
+static std::optional<double>
+_instructions_per_cycle(const test_result& result)
+{
+    if (!result.perf_counters.has_value() || (*result.perf_counters)[perf_counter::cycles].value_or(0) == 0 ||
+        !(*result.perf_counters)[perf_counter::instructions].has_value()) {
+        return {};
+    }
+    return static_cast<double>((*result.perf_counters)[perf_counter::instructions].value()) /
+           (*result.perf_counters)[perf_counter::cycles].value();
+}
+
+// Percentiles reported for slice duration histograms.
+static const std::pair<const char*, double> _slice_percentiles[] = {{"p50", 50}, {"p99", 99}, {"p99.9", 99.9}};
+
+// CSV output, with one row per test. The per-CPU columns cover every CPU, so the header is the same for all tests
+// whichever CPUs they use; columns of CPUs a test does not use are left empty.
+class csv_result_sink : public result_sink
+{
+  public:
+    csv_result_sink(std::ostream& out, size_t cpu_count) : out(out), cpu_count(cpu_count) {}
+
+    void
+    write(const test_result& result) override
+    {
+        if (!header_printed) {
+            print_header();
+            header_printed = true;
+        }
+
+        out << result.timestamp << "," << result.name << "," << result.group << ",";
+        for (size_t i = 0; i < result.parameters.size(); i++) {
+            out << (i ? ";" : "") << result.parameters[i].first << "=" << result.parameters[i].second;
+        }
+        out << ",";
+        print_environment_values(result.environment);
+        out << "," << result.trials << "," << result.iteration_count << ",";
+        out << std::llround(result.min_overlap_percent) << ",";
+        out << std::llround(result.operations_per_second) << ",";
+        if (result.scaling_cpu_count.has_value()) {
+            out << result.scaling_cpu_count.value();
+        }
+        out << ",";
+        if (result.scaling_efficiency.has_value()) {
+            out << _format_fraction(result.scaling_efficiency.value());
+        }
+        out << ",";
+        print_correction_values(result.corrected_duration);
+        out << ",";
+        print_ring_buffer_values(result.ring_buffer);
+        out << ",";
+        print_histogram_values(result.slice_durations);
+        out << ",";
+        print_perf_counter_values(result);
+        out << ",";
+        print_summary_values(result.duration);
+
+        auto cpu = result.cpus.begin();
+        for (size_t i = 0; i < cpu_count; i++) {
+            if (cpu == result.cpus.end() || cpu->cpu != i) {
+                out << std::string(16, ',');
+                continue;
+            }
+            out << "," << cpu->program << ",";
+            if (cpu->numa_node.has_value()) {
+                out << cpu->numa_node.value();
+            }
+            out << ",";
+            print_summary_values(cpu->duration);
+            out << ",";
+            if (cpu->corrected_duration.has_value()) {
+                out << _format_nanoseconds(cpu->corrected_duration->mean);
+            }
+            out << "," << std::llround(cpu->operations_per_second) << ",";
+            print_histogram_values(cpu->slice_durations);
+            cpu++;
+        }
+        out << std::endl;
+    }
+
+  private:
+    void
+    print_header()
+    {
+        out << "Timestamp,";
+        out << "Test,";
+        out << "Group,";
+        out << "Parameters,";
+        out << "Environment,";
+        out << "Trials,";
+        out << "Iteration Count,";
+        out << "Min Overlap (%),";
+        out << "Throughput (ops/s),";
+        out << "Scaling CPUs,";
+        out << "Scaling Efficiency,";
+        print_correction_header();
+        out << ",";
+        print_ring_buffer_header();
+        out << ",";
+        print_histogram_header("");
+        out << ",";
+        print_perf_counter_header();
+        out << ",";
+        print_summary_header("", "Average Duration");
+        for (size_t i = 0; i < cpu_count; i++) {
+            std::string prefix = "CPU " + std::to_string(i) + " ";
+            out << "," << prefix << "Program,";
+            out << prefix << "NUMA Node,";
+            print_summary_header(prefix, "Duration");
+            out << "," << prefix << "Corrected Duration (ns),";
+            out << prefix << "Throughput (ops/s),";
+            print_histogram_header(prefix);
+        }
+        out << std::endl;
+    }
+
+    // Print the environment as one column of name=value pairs. Values such as CPU lists contain commas, so the column
+    // is quoted.
+    void
+    print_environment_values(const environment_fingerprint& environment)
+    {
+        std::string value;
+        for (size_t i = 0; i < environment.size(); i++) {
+            value += (i ? ";" : "") + environment[i].first + "=" + environment[i].second;
+        }
+        out << "\"";
+        for (char c : value) {
+            out << (c == '"' ? "\"\"" : std::string(1, c));
+        }
+        out << "\"";
+    }
+
+    // Print the CSV header columns for summary_statistics, each column name prefixed with prefix.
+    // The mean is reported under the "Duration" name so existing consumers keep working.
+    void
+    print_summary_header(const std::string& prefix, const std::string& mean_column)
+    {
+        out << prefix << mean_column << " (ns),";
+        out << prefix << "Min Duration (ns),";
+        out << prefix << "Median Duration (ns),";
+        out << prefix << "P90 Duration (ns),";
+        out << prefix << "P99 Duration (ns),";
+        out << prefix << "Standard Deviation (ns),";
+        out << prefix << "CI95 Lower (ns),";
+        out << prefix << "CI95 Upper (ns)";
+    }
+
+    // Print the CSV values matching print_summary_header.
+    void
+    print_summary_values(const summary_statistics& summary)
+    {
+        out << _format_nanoseconds(summary.mean) << ",";
+        out << _format_nanoseconds(summary.min) << ",";
+        out << _format_nanoseconds(summary.median) << ",";
+        out << _format_nanoseconds(summary.p90) << ",";
+        out << _format_nanoseconds(summary.p99) << ",";
+        out << _format_nanoseconds(summary.standard_deviation) << ",";
+        out << _format_nanoseconds(summary.ci95_lower) << ",";
+        out << _format_nanoseconds(summary.ci95_upper);
+    }
+
+    // Print the CSV header columns for the slice duration histogram, each column name prefixed with prefix.
+    void
+    print_histogram_header(const std::string& prefix)
+    {
+        out << prefix << "Slice P50 (ns),";
+        out << prefix << "Slice P99 (ns),";
+        out << prefix << "Slice P99.9 (ns),";
+        out << prefix << "Slice Max (ns)";
+    }
+
+    // Print the CSV values matching print_histogram_header. The values are left empty if nothing was recorded.
+    void
+    print_histogram_values(const log_linear_histogram& histogram)
+    {
+        if (histogram.count() == 0) {
+            out << ",,,";
+            return;
+        }
+        for (auto& [name, percentile] : _slice_percentiles) {
+            out << histogram.value_at_percentile(percentile) << ",";
+        }
+        out << histogram.max();
+    }
+
+    // Print the CSV header columns for the baseline-corrected duration.
+    void
+    print_correction_header()
+    {
+        out << "Baseline (ns),";
+        out << "Corrected Duration (ns),";
+        out << "Corrected CI95 Lower (ns),";
+        out << "Corrected CI95 Upper (ns)";
+    }
+
+    // Print the CSV values matching print_correction_header, left empty for tests without a baseline.
+    void
+    print_correction_values(const std::optional<baseline_correction>& correction)
+    {
+        if (!correction.has_value()) {
+            out << ",,,";
+            return;
+        }
+        out << _format_nanoseconds(correction->baseline) << ",";
+        out << _format_nanoseconds(correction->mean) << ",";
+        out << _format_nanoseconds(correction->ci95_lower) << ",";
+        out << _format_nanoseconds(correction->ci95_upper);
+    }
+
+    // Print the CSV header columns for the ring buffer consumer.
+    void
+    print_ring_buffer_header()
+    {
+        out << "Produced (records/s),";
+        out << "Consumed (records/s),";
+        out << "Drop Rate (%),";
+        out << "Latency P50 (ns),";
+        out << "Latency P99 (ns),";
+        out << "Latency P99.9 (ns),";
+        out << "Latency Max (ns)";
+    }
+
+    // Print the CSV values matching print_ring_buffer_header, left empty for tests without a consumer.
+    void
+    print_ring_buffer_values(const std::optional<ring_buffer_result>& ring_buffer)
+    {
+        if (!ring_buffer.has_value()) {
+            out << ",,,,,,";
+            return;
+        }
+        out << std::llround(ring_buffer->produced_per_second) << ",";
+        out << std::llround(ring_buffer->consumed_per_second) << ",";
+        out << _format_fraction(ring_buffer->drop_percent) << ",";
+        auto& latency = ring_buffer->latency;
+        if (latency.count() == 0) {
+            out << ",,,";
+            return;
+        }
+        for (auto& [name, percentile] : _slice_percentiles) {
+            out << latency.value_at_percentile(percentile) << ",";
+        }
+        out << latency.max();
+    }
+
+    // Print the CSV header columns for the hardware performance counters, each normalized per operation.
+    void
+    print_perf_counter_header()
+    {
+        out << "Cycles/op,";
+        out << "Instructions/op,";
+        out << "IPC";
+        for (size_t i = static_cast<size_t>(perf_counter::l1d_misses); i < PERF_COUNTER_COUNT; i++) {
+            out << "," << perf_counter_name(static_cast<perf_counter>(i)) << "/op";
+        }
+    }
+
+    // Print the CSV values matching print_perf_counter_header. Counters that were not recorded are left empty.
+    void
+    print_perf_counter_values(const test_result& result)
+    {
+        auto print = [this](std::optional<double> value) {
+            if (value.has_value()) {
+                out << _format_fraction(value.value());
+            }
+        };
+
+        print(_perf_counter_per_operation(result, perf_counter::cycles));
+        out << ",";
+        print(_perf_counter_per_operation(result, perf_counter::instructions));
+        out << ",";
+        print(_instructions_per_cycle(result));
+        for (size_t i = static_cast<size_t>(perf_counter::l1d_misses); i < PERF_COUNTER_COUNT; i++) {
+            out << ",";
+            print(_perf_counter_per_operation(result, static_cast<perf_counter>(i)));
+        }
+    }
+
+    std::ostream& out;
+    size_t cpu_count;
+    bool header_printed = false;
+};
+
+// Escape a string for use in a JSON string or an OpenMetrics label value.
+static std::string
+_escape(const std::string& value)
+{
+    std::string escaped;
+    for (char c : value) {
+        switch (c) {
+        case '"':
+            escaped += "\\\"";
+            break;
+        case '\\':
+            escaped += "\\\\";
+            break;
+        case '\n':
+            escaped += "\\n";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                std::stringstream ss;
+                ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c);
+                escaped += ss.str();
+            } else {
+                escaped += c;
+            }
+        }
+    }
+    return escaped;
+}
+
+// Format a number for JSON, which has no representation for infinities or NaN.
+static std::string
+_json_number(double value)
+{
+    if (!std::isfinite(value)) {
+        return "null";
+    }
+    std::stringstream ss;
+    ss << std::setprecision(15) << value;
+    return ss.str();
+}
+
+static std::string
+_json_string(const std::string& value)
+{
+    return "\"" + _escape(value) + "\"";
+}
+
+// JSON Lines output, with one self-contained JSON object per test.
+class json_lines_result_sink : public result_sink
+{
+  public:
+    json_lines_result_sink(std::ostream& out) : out(out) {}
+
+    void
+    write(const test_result& result) override
+    {
+        out << "{\"timestamp\":" << _json_string(result.timestamp);
+        out << ",\"test\":" << _json_string(result.name);
+        out << ",\"group\":" << _json_string(result.group);
+        out << ",\"parameters\":{";
+        for (size_t i = 0; i < result.parameters.size(); i++) {
+            out << (i ? "," : "") << _json_string(result.parameters[i].first) << ":"
+                << _json_string(result.parameters[i].second);
+        }
+        out << "}";
+        out << ",\"environment\":{";
+        for (size_t i = 0; i < result.environment.size(); i++) {
+            out << (i ? "," : "") << _json_string(result.environment[i].first) << ":"
+                << _json_string(result.environment[i].second);
+        }
+        out << "}";
+        out << ",\"elf_file\":" << _json_string(result.elf_file);
+        out << ",\"program_type\":" << (result.program_type ? _json_string(*result.program_type) : "null");
+        out << ",\"trials\":" << result.trials;
+        out << ",\"warmup\":" << result.warmup;
+        out << ",\"iteration_count\":" << result.iteration_count;
+        out << ",\"batch_size\":" << result.batch_size;
+        out << ",\"min_overlap_percent\":" << _json_number(result.min_overlap_percent);
+        out << ",\"throughput_ops_per_second\":" << _json_number(result.operations_per_second);
+        if (result.scaling_cpu_count.has_value()) {
+            out << ",\"scaling_cpu_count\":" << result.scaling_cpu_count.value();
+        }
+        if (result.scaling_efficiency.has_value()) {
+            out << ",\"scaling_efficiency\":" << _json_number(result.scaling_efficiency.value());
+        }
+        if (result.ring_buffer.has_value()) {
+            auto& ring_buffer = result.ring_buffer.value();
+            out << ",\"ring_buffer\":{\"attempted_records\":" << ring_buffer.attempted;
+            out << ",\"consumed_records\":" << ring_buffer.consumed;
+            out << ",\"drop_percent\":" << _json_number(ring_buffer.drop_percent);
+            out << ",\"produced_records_per_second\":" << _json_number(ring_buffer.produced_per_second);
+            out << ",\"consumed_records_per_second\":" << _json_number(ring_buffer.consumed_per_second);
+            out << ",\"latency_ns\":";
+            write_histogram(ring_buffer.latency);
+            out << "}";
+        }
+        out << ",\"duration_ns\":";
+        write_summary(result.duration);
+        out << ",\"corrected_duration_ns\":";
+        write_correction(result.corrected_duration);
+        out << ",\"trial_durations_ns\":[";
+        for (size_t i = 0; i < result.trial_durations.size(); i++) {
+            out << (i ? "," : "") << _json_number(result.trial_durations[i]);
+        }
+        out << "]";
+        out << ",\"slice_duration_ns\":";
+        write_histogram(result.slice_durations);
+        out << ",\"perf_counters_per_op\":";
+        write_perf_counters(result);
+        out << ",\"cpus\":[";
+        for (size_t i = 0; i < result.cpus.size(); i++) {
+            auto& cpu = result.cpus[i];
+            out << (i ? "," : "");
+            out << "{\"cpu\":" << cpu.cpu;
+            out << ",\"numa_node\":" << (cpu.numa_node.has_value() ? std::to_string(*cpu.numa_node) : "null");
+            out << ",\"program\":" << _json_string(cpu.program);
+            out << ",\"return_value\":" << cpu.return_value;
+            out << ",\"operation_count\":" << cpu.operation_count;
+            out << ",\"throughput_ops_per_second\":" << _json_number(cpu.operations_per_second);
+            out << ",\"duration_ns\":";
+            write_summary(cpu.duration);
+            out << ",\"corrected_duration_ns\":";
+            write_correction(cpu.corrected_duration);
+            out << ",\"trial_durations_ns\":[";
+            for (size_t j = 0; j < cpu.trial_durations.size(); j++) {
+                out << (j ? "," : "") << _json_number(cpu.trial_durations[j]);
+            }
+            out << "],\"slice_duration_ns\":";
+            write_histogram(cpu.slice_durations);
+            out << "}";
+        }
+        out << "]}" << std::endl;
+    }
+
+  private:
+    void
+    write_summary(const summary_statistics& summary)
+    {
+        out << "{\"mean\":" << _json_number(summary.mean);
+        out << ",\"min\":" << _json_number(summary.min);
+        out << ",\"max\":" << _json_number(summary.max);
+        out << ",\"median\":" << _json_number(summary.median);
+        out << ",\"p90\":" << _json_number(summary.p90);
+        out << ",\"p99\":" << _json_number(summary.p99);
+        out << ",\"standard_deviation\":" << _json_number(summary.standard_deviation);
+        out << ",\"ci95_lower\":" << _json_number(summary.ci95_lower);
+        out << ",\"ci95_upper\":" << _json_number(summary.ci95_upper) << "}";
+    }
+
+    void
+    write_correction(const std::optional<baseline_correction>& correction)
+    {
+        if (!correction.has_value()) {
+            out << "null";
+            return;
+        }
+        out << "{\"baseline\":" << _json_number(correction->baseline);
+        out << ",\"mean\":" << _json_number(correction->mean);
+        out << ",\"ci95_lower\":" << _json_number(correction->ci95_lower);
+        out << ",\"ci95_upper\":" << _json_number(correction->ci95_upper) << "}";
+    }
+
+    void
+    write_histogram(const log_linear_histogram& histogram)
+    {
+        if (histogram.count() == 0) {
+            out << "null";
+            return;
+        }
+        out << "{";
+        for (auto& [name, percentile] : _slice_percentiles) {
+            out << _json_string(name) << ":" << histogram.value_at_percentile(percentile) << ",";
+        }
+        out << "\"max\":" << histogram.max() << ",\"count\":" << histogram.count() << "}";
+    }
+
+    void
+    write_perf_counters(const test_result& result)
+    {
+        if (!result.perf_counters.has_value()) {
+            out << "null";
+            return;
+        }
+        auto write_value = [this](std::optional<double> value) {
+            out << (value.has_value() ? _json_number(value.value()) : "null");
+        };
+        out << "{";
+        for (size_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+            out << _json_string(perf_counter_name(static_cast<perf_counter>(i))) << ":";
+            write_value(_perf_counter_per_operation(result, static_cast<perf_counter>(i)));
+            out << ",";
+        }
+        out << "\"IPC\":";
+        write_value(_instructions_per_cycle(result));
+        out << "}";
+    }
+
+    std::ostream& out;
+};
+
+// OpenMetrics text output. All samples of a metric family must be written together, so samples are collected per
+// family and written once all tests have run.
+class openmetrics_result_sink : public result_sink
+{
+  public:
+    openmetrics_result_sink(std::ostream& out) : out(out) {}
+
+    void
+    write(const test_result& result) override
+    {
+        labels test_labels = {{"test", result.name}, {"group", result.group}};
+
+        labels environment_labels = test_labels;
+        environment_labels.insert(environment_labels.end(), result.environment.begin(), result.environment.end());
+        add("bpf_performance_environment_info", "State of the host the test ran on", environment_labels, 1);
+
+        add("bpf_performance_iteration_count", "Iterations per run of each CPU", test_labels, result.iteration_count);
+        add("bpf_performance_min_overlap_percent",
+            "Smallest share of a trial during which all CPUs ran concurrently",
+            test_labels,
+            result.min_overlap_percent);
+        add("bpf_performance_throughput_operations_per_second",
+            "Mean aggregate throughput across CPUs",
+            test_labels,
+            result.operations_per_second);
+        if (result.scaling_efficiency.has_value()) {
+            add("bpf_performance_scaling_efficiency",
+                "Aggregate throughput of the swept CPUs relative to linear scaling from one CPU",
+                test_labels,
+                result.scaling_efficiency.value());
+        }
+        if (result.ring_buffer.has_value()) {
+            auto& ring_buffer = result.ring_buffer.value();
+            add("bpf_performance_ring_buffer_produced_records_per_second",
+                "Mean rate at which records were written to the ring buffer",
+                test_labels,
+                ring_buffer.produced_per_second);
+            add("bpf_performance_ring_buffer_consumed_records_per_second",
+                "Mean rate at which the consumer read records while the producers ran",
+                test_labels,
+                ring_buffer.consumed_per_second);
+            add("bpf_performance_ring_buffer_drop_percent",
+                "Share of records dropped because the ring buffer was full",
+                test_labels,
+                ring_buffer.drop_percent);
+            add_histogram(
+                "bpf_performance_ring_buffer_latency_nanoseconds",
+                "Time from when a record was produced until it was consumed",
+                test_labels,
+                ring_buffer.latency);
+        }
+        add_summary(
+            "bpf_performance_duration_nanoseconds",
+            "Per-trial mean duration of one iteration across CPUs",
+            test_labels,
+            result.duration);
+        if (result.corrected_duration.has_value()) {
+            add_correction(
+                "bpf_performance_corrected_duration_nanoseconds",
+                "Per-trial mean duration of one iteration across CPUs, less that of the baseline program",
+                test_labels,
+                result.corrected_duration.value());
+        }
+        add_histogram(
+            "bpf_performance_slice_duration_nanoseconds",
+            "Per-slice mean duration of one iteration across CPUs",
+            test_labels,
+            result.slice_durations);
+
+        if (result.perf_counters.has_value()) {
+            for (size_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+                auto value = _perf_counter_per_operation(result, static_cast<perf_counter>(i));
+                if (value.has_value()) {
+                    labels counter_labels = test_labels;
+                    counter_labels.push_back({"counter", perf_counter_name(static_cast<perf_counter>(i))});
+                    add("bpf_performance_perf_counter_per_operation",
+                        "Hardware counter per iteration, summed across CPUs",
+                        counter_labels,
+                        value.value());
+                }
+            }
+            auto instructions_per_cycle = _instructions_per_cycle(result);
+            if (instructions_per_cycle.has_value()) {
+                add("bpf_performance_instructions_per_cycle",
+                    "Instructions per cycle across CPUs",
+                    test_labels,
+                    instructions_per_cycle.value());
+            }
+        }
+
+        for (auto& cpu : result.cpus) {
+            labels cpu_labels = test_labels;
+            cpu_labels.push_back({"cpu", std::to_string(cpu.cpu)});
+            if (cpu.numa_node.has_value()) {
+                cpu_labels.push_back({"numa_node", std::to_string(cpu.numa_node.value())});
+            }
+            cpu_labels.push_back({"program", cpu.program});
+            add("bpf_performance_cpu_return_value",
+                "Return value of the program in the last trial",
+                cpu_labels,
+                cpu.return_value);
+            add("bpf_performance_cpu_operation_count",
+                "Iterations run across the measured trials",
+                cpu_labels,
+                static_cast<double>(cpu.operation_count));
+            add("bpf_performance_cpu_throughput_operations_per_second",
+                "Mean throughput of one CPU",
+                cpu_labels,
+                cpu.operations_per_second);
+            add_summary(
+                "bpf_performance_cpu_duration_nanoseconds",
+                "Per-trial mean duration of one iteration on one CPU",
+                cpu_labels,
+                cpu.duration);
+            if (cpu.corrected_duration.has_value()) {
+                add_correction(
+                    "bpf_performance_cpu_corrected_duration_nanoseconds",
+                    "Per-trial mean duration of one iteration on one CPU, less that of the baseline program",
+                    cpu_labels,
+                    cpu.corrected_duration.value());
+            }
+            add_histogram(
+                "bpf_performance_cpu_slice_duration_nanoseconds",
+                "Per-slice mean duration of one iteration on one CPU",
+                cpu_labels,
+                cpu.slice_durations);
+        }
+    }
+
+    void
+    finish() override
+    {
+        for (auto& name : family_order) {
+            auto& family = families[name];
+            out << "# TYPE " << name << " gauge" << std::endl;
+            out << "# HELP " << name << " " << family.help << std::endl;
+            for (auto& sample : family.samples) {
+                out << sample << std::endl;
+            }
+        }
+        out << "# EOF" << std::endl;
+    }
+
+  private:
+    typedef std::vector<std::pair<std::string, std::string>> labels;
+
+    struct metric_family
+    {
+        std::string help;
+        std::vector<std::string> samples;
+    };
+
+    void
+    add(const std::string& name, const std::string& help, const labels& sample_labels, double value)
+    {
+        if (families.find(name) == families.end()) {
+            family_order.push_back(name);
+            families[name].help = help;
+        }
+
+        std::stringstream sample;
+        sample << name << "{";
+        for (size_t i = 0; i < sample_labels.size(); i++) {
+            sample << (i ? "," : "") << sample_labels[i].first << "=\"" << _escape(sample_labels[i].second) << "\"";
+        }
+        sample << "} ";
+        if (std::isfinite(value)) {
+            sample << std::setprecision(15) << value;
+        } else {
+            sample << "NaN";
+        }
+        families[name].samples.push_back(sample.str());
+    }
+
+    void
+    add_summary(
+        const std::string& name,
+        const std::string& help,
+        const labels& sample_labels,
+        const summary_statistics& summary)
+    {
+        const std::pair<const char*, double> statistics[] = {
+            {"mean", summary.mean},
+            {"min", summary.min},
+            {"max", summary.max},
+            {"median", summary.median},
+            {"p90", summary.p90},
+            {"p99", summary.p99},
+            {"standard_deviation", summary.standard_deviation},
+            {"ci95_lower", summary.ci95_lower},
+            {"ci95_upper", summary.ci95_upper},
+        };
+        for (auto& [statistic, value] : statistics) {
+            labels statistic_labels = sample_labels;
+            statistic_labels.push_back({"statistic", statistic});
+            add(name, help, statistic_labels, value);
+        }
+    }
+
+    void
+    add_correction(
+        const std::string& name,
+        const std::string& help,
+        const labels& sample_labels,
+        const baseline_correction& correction)
+    {
+        const std::pair<const char*, double> statistics[] = {
+            {"baseline", correction.baseline},
+            {"mean", correction.mean},
+            {"ci95_lower", correction.ci95_lower},
+            {"ci95_upper", correction.ci95_upper},
+        };
+        for (auto& [statistic, value] : statistics) {
+            labels statistic_labels = sample_labels;
+            statistic_labels.push_back({"statistic", statistic});
+            add(name, help, statistic_labels, value);
+        }
+    }
+
+    void
+    add_histogram(
+        const std::string& name,
+        const std::string& help,
+        const labels& sample_labels,
+        const log_linear_histogram& histogram)
+    {
+        if (histogram.count() == 0) {
+            return;
+        }
+        for (auto& [percentile_name, percentile] : _slice_percentiles) {
+            labels percentile_labels = sample_labels;
+            percentile_labels.push_back({"percentile", percentile_name});
+            add(name, help, percentile_labels, static_cast<double>(histogram.value_at_percentile(percentile)));
+        }
+        labels max_labels = sample_labels;
+        max_labels.push_back({"percentile", "max"});
+        add(name, help, max_labels, static_cast<double>(histogram.max()));
+    }
+
+    std::ostream& out;
+    std::vector<std::string> family_order;
+    std::map<std::string, metric_family> families;
+};
+
+std::unique_ptr<result_sink>
+create_result_sink(const std::string& format, std::ostream& out, size_t cpu_count)
+{
+    if (format == "csv") {
+        return std::make_unique<csv_result_sink>(out, cpu_count);
+    } else if (format == "jsonl") {
+        return std::make_unique<json_lines_result_sink>(out);
+    } else if (format == "openmetrics") {
+        return std::make_unique<openmetrics_result_sink>(out);
+    }
+    throw std::runtime_error("Unknown output format " + format);
+}
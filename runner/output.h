@@ -0,0 +1,133 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "environment.h"
+#include "histogram.h"
+#include "perf_counters.h"
+#include "statistics.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Results of one CPU that ran a program in a test.
+ */
+struct cpu_result
+{
+    size_t cpu = 0;
+    // NUMA node of the CPU, when the topology of the host could be read.
+    std::optional<int> numa_node;
+    std::string program;
+    // Return value of the program in the last measured trial.
+    uint32_t return_value = 0;
+    // Iterations run across all measured trials.
+    uint64_t operation_count = 0;
+    // Mean per-iteration duration of each measured trial, in nanoseconds.
+    std::vector<double> trial_durations;
+    summary_statistics duration;
+    // Mean duration with that of the baseline program on the same CPU subtracted, when a baseline was measured.
+    std::optional<baseline_correction> corrected_duration;
+    // Mean throughput across the measured trials.
+    double operations_per_second = 0;
+    log_linear_histogram slice_durations;
+};
+
+/**
+ * @brief Results of the ring buffer consumer of a test.
+ */
+struct ring_buffer_result
+{
+    // Records the producers tried to write and records the consumer read, across the measured trials. Records that
+    // were not read were dropped because the buffer was full.
+    uint64_t attempted = 0;
+    uint64_t consumed = 0;
+    double drop_percent = 0;
+    // Mean rates over the time the producers ran: records written to the buffer, and records read while the
+    // producers were still running.
+    double produced_per_second = 0;
+    double consumed_per_second = 0;
+    // Time from when a producer stamped each record until the consumer read it, in nanoseconds.
+    log_linear_histogram latency;
+};
+
+/**
+ * @brief Results of one test, as passed to a result_sink.
+ */
+struct test_result
+{
+    std::string timestamp;
+    std::string name;
+    // Name shared by the tests expanded from one matrix, and the matrix values of this test.
+    std::string group;
+    std::vector<std::pair<std::string, std::string>> parameters;
+    // State of the host the test ran on.
+    environment_fingerprint environment;
+    std::string elf_file;
+    std::optional<std::string> program_type;
+    int trials = 0;
+    int warmup = 0;
+    int iteration_count = 0;
+    int batch_size = 0;
+    // Smallest share of a trial during which all CPUs ran concurrently.
+    double min_overlap_percent = 0;
+    // Mean aggregate throughput across the measured trials.
+    double operations_per_second = 0;
+    // Mean per-iteration duration across CPUs of each measured trial, in nanoseconds, and their summary.
+    std::vector<double> trial_durations;
+    summary_statistics duration;
+    // Mean duration with that of the baseline program on the same CPUs subtracted, when a baseline was measured.
+    std::optional<baseline_correction> corrected_duration;
+    log_linear_histogram slice_durations;
+    // Set for each point of a scaling sweep: the number of swept CPUs, and their aggregate throughput relative to that
+    // many times the throughput of a single swept CPU.
+    std::optional<size_t> scaling_cpu_count;
+    std::optional<double> scaling_efficiency;
+    // Set for tests with a ring buffer consumer.
+    std::optional<ring_buffer_result> ring_buffer;
+    // Counters summed across CPUs and measured trials, and the number of operations they cover.
+    std::optional<perf_counter_values> perf_counters;
+    uint64_t perf_counter_operations = 0;
+    // One entry per CPU that ran a program, in CPU order.
+    std::vector<cpu_result> cpus;
+};
+
+/**
+ * @brief Destination for test results in a particular format.
+ */
+class result_sink
+{
+  public:
+    virtual ~result_sink() = default;
+
+    /**
+     * @brief Write the results of a test.
+     */
+    virtual void
+    write(const test_result& result) = 0;
+
+    /**
+     * @brief Called once after the last test, for formats that are written as a whole.
+     */
+    virtual void
+    finish()
+    {
+    }
+};
+
+/**
+ * @brief Create a result sink for the named format.
+ *
+ * @param[in] format One of "csv", "jsonl" or "openmetrics".
+ * @param[in] out Stream to write the results to.
+ * @param[in] cpu_count Number of CPUs, used for the per-CPU columns of the CSV format.
+ * @return The sink.
+ */
+std::unique_ptr<result_sink>
+create_result_sink(const std::string& format, std::ostream& out, size_t cpu_count);
@@ -0,0 +1,147 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "perf_counters.h"
+
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char* _perf_counter_names[PERF_COUNTER_COUNT] = {
+    "Cycles",
+    "Instructions",
+    "L1d Misses",
+    "LLC Misses",
+    "Branch Misses",
+    "dTLB Misses",
+};
+
+// Set once the warning for an unsupported counter has been printed.
+static std::atomic<bool> _unsupported_warning_printed[PERF_COUNTER_COUNT];
+
+const char*
+perf_counter_name(perf_counter counter)
+{
+    return _perf_counter_names[static_cast<size_t>(counter)];
+}
+
+perf_counter_values&
+perf_counter_values::operator+=(const perf_counter_values& other)
+{
+    for (size_t i = 0; i < values.size(); i++) {
+        if (values[i].has_value() && other.values[i].has_value()) {
+            values[i] = values[i].value() + other.values[i].value();
+        } else {
+            values[i].reset();
+        }
+    }
+    return *this;
+}
+
+#if defined(__linux__)
+// The perf event type and config of each counter, in perf_counter order.
+static const std::pair<uint32_t, uint64_t> _perf_counter_events[PERF_COUNTER_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+#endif
+
+perf_counter_set::perf_counter_set()
+{
+    fds.fill(-1);
+#if defined(__linux__)
+    for (size_t i = 0; i < fds.size(); i++) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = _perf_counter_events[i].first;
+        attr.config = _perf_counter_events[i].second;
+        attr.disabled = 1;
+        // BPF programs run in the kernel, so kernel time must be counted.
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // Count the calling thread on whichever CPU it runs.
+        fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fds[i] < 0 && !_unsupported_warning_printed[i].exchange(true)) {
+            std::cerr << "Warning: Hardware counter " << _perf_counter_names[i]
+                      << " is not available: " << strerror(errno) << std::endl;
+        }
+    }
+#endif
+}
+
+perf_counter_set::~perf_counter_set()
+{
+#if defined(__linux__)
+    for (int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+void
+perf_counter_set::start()
+{
+#if defined(__linux__)
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void
+perf_counter_set::stop()
+{
+#if defined(__linux__)
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+}
+
+perf_counter_values
+perf_counter_set::read() const
+{
+    perf_counter_values result;
+    for (size_t i = 0; i < fds.size(); i++) {
+        result.values[i].reset();
+#if defined(__linux__)
+        if (fds[i] < 0) {
+            continue;
+        }
+
+        // Value, time enabled and time running, per PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING.
+        uint64_t data[3];
+        if (::read(fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+            continue;
+        }
+
+        // Scale up if the counter was multiplexed with other events.
+        double scale = static_cast<double>(data[1]) / static_cast<double>(data[2]);
+        result.values[i] = static_cast<uint64_t>(static_cast<double>(data[0]) * scale);
+#endif
+    }
+    return result;
+}
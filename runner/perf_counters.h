@@ -0,0 +1,101 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+/**
+ * @brief The hardware events counted by perf_counter_set, in the order they are reported.
+ */
+enum class perf_counter
+{
+    cycles,
+    instructions,
+    l1d_misses,
+    llc_misses,
+    branch_misses,
+    dtlb_misses,
+};
+
+#define PERF_COUNTER_COUNT 6
+
+/**
+ * @brief Get the name of a counter as used in the output.
+ */
+const char*
+perf_counter_name(perf_counter counter);
+
+/**
+ * @brief Counter values, with counters that could not be read left empty.
+ */
+struct perf_counter_values
+{
+    perf_counter_values() { values.fill(0); }
+
+    std::array<std::optional<uint64_t>, PERF_COUNTER_COUNT> values;
+
+    /**
+     * @brief Add the values of another set of counters. A counter becomes empty if it is empty in either set.
+     *
+     * @param[in] other The values to add.
+     */
+    perf_counter_values&
+    operator+=(const perf_counter_values& other);
+
+    std::optional<uint64_t>&
+    operator[](perf_counter counter)
+    {
+        return values[static_cast<size_t>(counter)];
+    }
+
+    const std::optional<uint64_t>&
+    operator[](perf_counter counter) const
+    {
+        return values[static_cast<size_t>(counter)];
+    }
+};
+
+/**
+ * @brief Hardware performance counters for the calling thread, including the time it spends in the kernel running BPF
+ * programs.
+ *
+ * Counters the host does not support, for example in a virtual machine, are skipped with a one-time warning. Counters
+ * are only supported on Linux; elsewhere every value is empty.
+ */
+class perf_counter_set
+{
+  public:
+    /**
+     * @brief Open the counters for the calling thread. They are not counting until start is called.
+     */
+    perf_counter_set();
+    perf_counter_set(const perf_counter_set&) = delete;
+    perf_counter_set&
+    operator=(const perf_counter_set&) = delete;
+    ~perf_counter_set();
+
+    /**
+     * @brief Reset the counters to zero and start counting.
+     */
+    void
+    start();
+
+    /**
+     * @brief Stop counting.
+     */
+    void
+    stop();
+
+    /**
+     * @brief Read the counters, scaled up for any time they were not scheduled on the PMU.
+     */
+    perf_counter_values
+    read() const;
+
+  private:
+    std::array<int, PERF_COUNTER_COUNT> fds;
+};
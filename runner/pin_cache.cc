@@ -0,0 +1,338 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "pin_cache.h"
+
+#include "map_snapshot.h"
+
+#include <algorithm>
+#include <bpf/bpf.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/bpf.h>
+#include <unistd.h>
+#endif
+
+// FNV-1a parameters for 64-bit hashes.
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+pinned_object::~pinned_object()
+{
+#if defined(__linux__)
+    for (auto& [name, fd] : program_fds) {
+        close(fd);
+    }
+    for (auto& [name, fd] : map_fds) {
+        close(fd);
+    }
+#endif
+}
+
+// Hash the contents of a file. This only needs to tell builds of an ELF file apart, so FNV-1a is sufficient.
+static uint64_t
+_hash_file(const std::string& file)
+{
+    std::ifstream stream(file, std::ios::binary);
+    if (!stream) {
+        throw std::runtime_error("Failed to open " + file + " for hashing");
+    }
+
+    uint64_t hash = FNV_OFFSET_BASIS;
+    std::vector<char> buffer(64 * 1024);
+    while (stream) {
+        stream.read(buffer.data(), buffer.size());
+        for (std::streamsize i = 0; i < stream.gcount(); i++) {
+            hash = (hash ^ static_cast<uint8_t>(buffer[i])) * FNV_PRIME;
+        }
+    }
+    return hash;
+}
+
+// Hash a string, such as the parameters an object was loaded with.
+static uint64_t
+_hash_string(const std::string& value)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (char c : value) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// bpffs does not allow '.' in names, which libbpf uses for internal maps such as .data and .bss.
+static std::string
+_pin_name(const std::string& prefix, const std::string& name)
+{
+    std::string pin_name = prefix + name;
+    std::replace(pin_name.begin(), pin_name.end(), '.', '_');
+    return pin_name;
+}
+
+#if defined(__linux__)
+// Discard ring buffer records.
+static int
+_discard_record(void*, void*, size_t)
+{
+    return 0;
+}
+
+// Reset a map reused from the cache to the state it had when the object was first loaded, given the initial value of
+// global data maps. Inner maps of map-in-maps are reached through the outer map and reset as well.
+static void
+_reset_map(int fd, const std::string& name, const void* initial_value, size_t initial_value_size)
+{
+    bpf_map_info info = {};
+    uint32_t info_size = sizeof(info);
+    if (bpf_obj_get_info_by_fd(fd, &info, &info_size) < 0) {
+        throw std::runtime_error("Failed to reset map " + name + ": " + strerror(errno));
+    }
+
+    // .rodata is frozen at load and cannot have changed.
+    if (info.map_flags & BPF_F_RDONLY_PROG) {
+        return;
+    }
+
+    switch (info.type) {
+    case BPF_MAP_TYPE_HASH:
+    case BPF_MAP_TYPE_PERCPU_HASH:
+    case BPF_MAP_TYPE_LRU_HASH:
+    case BPF_MAP_TYPE_LRU_PERCPU_HASH:
+    case BPF_MAP_TYPE_LPM_TRIE: {
+        // Read every key first and delete them in one batch. Deleting the first key until none is left restarts the
+        // key walk each time, which is quadratic in the number of elements.
+        size_t value_size = info.value_size;
+        if (info.type == BPF_MAP_TYPE_PERCPU_HASH || info.type == BPF_MAP_TYPE_LRU_PERCPU_HASH) {
+            // Per-CPU values are read as one 8-byte aligned value per possible CPU.
+            value_size = ((value_size + 7) & ~static_cast<size_t>(7)) * libbpf_num_possible_cpus();
+        }
+        std::vector<uint8_t> keys;
+        std::vector<uint8_t> values;
+        uint32_t current_count = read_map_elements(fd, name, info.key_size, value_size, info.max_entries, keys, values);
+
+        bpf_map_batch_opts opts;
+        memset(&opts, 0, sizeof(opts));
+        opts.sz = sizeof(opts);
+        uint32_t count = current_count;
+        if (current_count > 0 && bpf_map_delete_batch(fd, keys.data(), &count, &opts) < 0) {
+            for (uint32_t i = 0; i < current_count; i++) {
+                if (bpf_map_delete_elem(fd, keys.data() + i * info.key_size) < 0 && errno != ENOENT) {
+                    throw std::runtime_error("Failed to reset map " + name + ": " + strerror(errno));
+                }
+            }
+        }
+        break;
+    }
+    case BPF_MAP_TYPE_ARRAY:
+    case BPF_MAP_TYPE_PERCPU_ARRAY: {
+        size_t value_size = info.value_size;
+        size_t cpu_count = 1;
+        if (info.type == BPF_MAP_TYPE_PERCPU_ARRAY) {
+            // Per-CPU values are passed as one 8-byte aligned value per possible CPU.
+            value_size = (value_size + 7) & ~static_cast<size_t>(7);
+            cpu_count = libbpf_num_possible_cpus();
+        }
+
+        // Global data maps start out with the values from the ELF file, other arrays start out zeroed.
+        std::vector<uint8_t> value(value_size * cpu_count);
+        if (initial_value) {
+            for (size_t cpu = 0; cpu < cpu_count; cpu++) {
+                memcpy(value.data() + cpu * value_size, initial_value, std::min(initial_value_size, value_size));
+            }
+        }
+
+        for (uint32_t key = 0; key < info.max_entries; key++) {
+            if (bpf_map_update_elem(fd, &key, value.data(), BPF_ANY) < 0) {
+                throw std::runtime_error("Failed to reset map " + name + ": " + strerror(errno));
+            }
+        }
+        break;
+    }
+    case BPF_MAP_TYPE_ARRAY_OF_MAPS:
+    case BPF_MAP_TYPE_HASH_OF_MAPS: {
+        // The outer map keeps the inner maps set up at load, but the entries of those inner maps are test state.
+        // Looking up an outer map from user space returns the id of the inner map.
+        std::vector<uint8_t> key(info.key_size);
+        std::vector<uint8_t> next_key(info.key_size);
+        void* previous_key = nullptr;
+        while (bpf_map_get_next_key(fd, previous_key, next_key.data()) == 0) {
+            key.swap(next_key);
+            previous_key = key.data();
+
+            uint32_t inner_map_id;
+            if (bpf_map_lookup_elem(fd, key.data(), &inner_map_id) < 0) {
+                // Empty slots of an array of maps.
+                if (errno == ENOENT) {
+                    continue;
+                }
+                throw std::runtime_error("Failed to reset map " + name + ": " + strerror(errno));
+            }
+
+            int inner_map_fd = bpf_map_get_fd_by_id(inner_map_id);
+            if (inner_map_fd < 0) {
+                throw std::runtime_error("Failed to reset map " + name + ": " + strerror(errno));
+            }
+            try {
+                _reset_map(inner_map_fd, name + " inner map " + std::to_string(inner_map_id), nullptr, 0);
+            } catch (...) {
+                close(inner_map_fd);
+                throw;
+            }
+            close(inner_map_fd);
+        }
+        break;
+    }
+    case BPF_MAP_TYPE_RINGBUF: {
+        // Records the last test left unread would otherwise be consumed by the next test's consumer.
+        ring_buffer* buffer = ring_buffer__new(fd, _discard_record, nullptr, nullptr);
+        if (!buffer) {
+            throw std::runtime_error("Failed to reset map " + name + ": " + strerror(errno));
+        }
+        int result = ring_buffer__consume(buffer);
+        ring_buffer__free(buffer);
+        if (result < 0) {
+            throw std::runtime_error("Failed to reset map " + name + ": " + strerror(-result));
+        }
+        break;
+    }
+    default:
+        // Program arrays keep the references set up at load, and perf event arrays only hold events opened by the
+        // process that filled them, which are released when it exits.
+        break;
+    }
+}
+
+// Reset a map of a reused object, starting from the initial value libbpf recorded for global data maps.
+static void
+_reset_map(int fd, bpf_map* map)
+{
+    size_t initial_value_size = 0;
+    const void* initial_value = bpf_map__initial_value(map, &initial_value_size);
+    _reset_map(fd, bpf_map__name(map), initial_value, initial_value_size);
+}
+#endif
+
+pinned_object_ptr
+pin_cache::lookup(const std::string& elf_file, bpf_prog_type prog_type, const std::string& parameters, bpf_object* obj)
+    const
+{
+#if defined(__linux__)
+    std::filesystem::path path = entry_path(elf_file, prog_type, parameters);
+    if (!std::filesystem::exists(path)) {
+        return nullptr;
+    }
+
+    auto pinned = std::make_unique<pinned_object>();
+
+    bpf_program* program;
+    bpf_object__for_each_program(program, obj)
+    {
+        std::string name = bpf_program__name(program);
+        int fd = bpf_obj_get((path / _pin_name("prog_", name)).c_str());
+        if (fd < 0) {
+            // Treat an entry that does not match the object as a miss.
+            return nullptr;
+        }
+        pinned->program_fds[name] = fd;
+    }
+
+    bpf_map* map;
+    bpf_object__for_each_map(map, obj)
+    {
+        std::string name = bpf_map__name(map);
+        int fd = bpf_obj_get((path / _pin_name("map_", name)).c_str());
+        if (fd < 0) {
+            return nullptr;
+        }
+        pinned->map_fds[name] = fd;
+        _reset_map(fd, map);
+    }
+
+    return pinned;
+#else
+    throw std::runtime_error("The pinned-object cache is only supported on Linux");
+#endif
+}
+
+void
+pin_cache::store(const std::string& elf_file, bpf_prog_type prog_type, const std::string& parameters, bpf_object* obj)
+    const
+{
+#if defined(__linux__)
+    std::filesystem::path path = entry_path(elf_file, prog_type, parameters);
+    if (std::filesystem::exists(path)) {
+        return;
+    }
+
+    // Build the entry under a name private to this process, then rename it into place.
+    std::filesystem::path temporary_path = path;
+    temporary_path += "_tmp_" + std::to_string(getpid());
+    std::filesystem::remove_all(temporary_path);
+    std::filesystem::create_directories(temporary_path);
+
+    try {
+        bpf_program* program;
+        bpf_object__for_each_program(program, obj)
+        {
+            std::string name = bpf_program__name(program);
+            if (bpf_obj_pin(bpf_program__fd(program), (temporary_path / _pin_name("prog_", name)).c_str()) < 0) {
+                throw std::runtime_error("Failed to pin program " + name + ": " + strerror(errno));
+            }
+        }
+
+        bpf_map* map;
+        bpf_object__for_each_map(map, obj)
+        {
+            std::string name = bpf_map__name(map);
+            if (bpf_obj_pin(bpf_map__fd(map), (temporary_path / _pin_name("map_", name)).c_str()) < 0) {
+                throw std::runtime_error("Failed to pin map " + name + ": " + strerror(errno));
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary_path, path, error);
+        if (error) {
+            // Another runner may have stored the same entry first.
+            if (!std::filesystem::exists(path)) {
+                throw std::runtime_error("Failed to create " + path.string() + ": " + error.message());
+            }
+            std::filesystem::remove_all(temporary_path);
+        }
+    } catch (...) {
+        std::error_code error;
+        std::filesystem::remove_all(temporary_path, error);
+        throw;
+    }
+#else
+    throw std::runtime_error("The pinned-object cache is only supported on Linux");
+#endif
+}
+
+void
+pin_cache::purge() const
+{
+#if defined(__linux__)
+    std::filesystem::remove_all(directory);
+#else
+    throw std::runtime_error("The pinned-object cache is only supported on Linux");
+#endif
+}
+
+std::string
+pin_cache::entry_path(const std::string& elf_file, bpf_prog_type prog_type, const std::string& parameters) const
+{
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << _hash_file(elf_file) << std::dec << "_" << prog_type;
+    // The parameters change the programs the verifier accepts, so each set of them gets an entry of its own.
+    if (!parameters.empty()) {
+        name << "_" << std::hex << std::setw(16) << std::setfill('0') << _hash_string(parameters);
+    }
+    return (std::filesystem::path(directory) / name.str()).string();
+}
@@ -0,0 +1,91 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <bpf/libbpf.h>
+#include <map>
+#include <memory>
+#include <string>
+
+// Default directory of the pinned-object cache. It must be on a bpffs mount.
+#define DEFAULT_PIN_CACHE_DIRECTORY "/sys/fs/bpf/bpf_performance"
+
+/**
+ * @brief File descriptors of the programs and maps of a BPF object reused from the pinned-object cache.
+ *
+ * The descriptors are closed when the object is destroyed. The pins themselves are left in place.
+ */
+struct pinned_object
+{
+    pinned_object() = default;
+    pinned_object(const pinned_object&) = delete;
+    pinned_object&
+    operator=(const pinned_object&) = delete;
+    ~pinned_object();
+
+    // Program file descriptors by program name.
+    std::map<std::string, int> program_fds;
+    // Map file descriptors by map name.
+    std::map<std::string, int> map_fds;
+};
+
+typedef std::unique_ptr<pinned_object> pinned_object_ptr;
+
+/**
+ * @brief A cache of loaded BPF objects pinned in bpffs, so that later invocations of the runner can reuse the verified
+ * programs and maps instead of loading the ELF file again.
+ *
+ * Each entry is a directory named after a hash of the ELF file contents, the program type the object was loaded
+ * with and the parameters written into its read-only globals, holding one pin per program and per map. Entries are
+ * created under a temporary name and renamed into place once complete, so concurrent runners never see a partial
+ * entry.
+ */
+class pin_cache
+{
+  public:
+    /**
+     * @brief Construct a cache rooted at the given bpffs directory.
+     *
+     * @param[in] directory Root directory of the cache.
+     */
+    pin_cache(const std::string& directory) : directory(directory) {}
+
+    /**
+     * @brief Look up a loaded object in the cache.
+     *
+     * On a hit, the data maps of the object, the inner maps of its map-in-maps and its ring buffers are reset to their
+     * initial state before they are returned.
+     *
+     * @param[in] elf_file Path to the ELF file the object was loaded from.
+     * @param[in] prog_type Program type the object was loaded with.
+     * @param[in] parameters Parameters written into the read-only globals of the object, formatted as name=value pairs.
+     * @param[in] obj The object opened, but not loaded, from elf_file. Used to enumerate its programs and maps.
+     * @return The pinned programs and maps, or nullptr if the object is not in the cache.
+     */
+    pinned_object_ptr
+    lookup(const std::string& elf_file, bpf_prog_type prog_type, const std::string& parameters, bpf_object* obj) const;
+
+    /**
+     * @brief Pin the programs and maps of a loaded object into the cache.
+     *
+     * @param[in] elf_file Path to the ELF file the object was loaded from.
+     * @param[in] prog_type Program type the object was loaded with.
+     * @param[in] parameters Parameters written into the read-only globals of the object, formatted as name=value pairs.
+     * @param[in] obj The loaded object.
+     */
+    void
+    store(const std::string& elf_file, bpf_prog_type prog_type, const std::string& parameters, bpf_object* obj) const;
+
+    /**
+     * @brief Remove every entry from the cache.
+     */
+    void
+    purge() const;
+
+  private:
+    std::string
+    entry_path(const std::string& elf_file, bpf_prog_type prog_type, const std::string& parameters) const;
+
+    std::string directory;
+};
@@ -0,0 +1,163 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "regression.h"
+
+#include "statistics.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <yaml-cpp/yaml.h>
+
+// Format a value with a fixed number of decimals, and a sign if requested.
+static std::string
+_format(double value, int precision, bool sign = false)
+{
+    std::stringstream ss;
+    ss << (sign ? std::showpos : std::noshowpos) << std::fixed << std::setprecision(precision) << value;
+    return ss.str();
+}
+
+// Get the median of a set of samples.
+static double
+_median(std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    return percentile_of_sorted(samples, 50);
+}
+
+regression_check::regression_check(
+    const std::string& previous_results_file, double threshold_percent, double significance)
+    : previous_results_file(previous_results_file), threshold_percent(threshold_percent), significance(significance)
+{
+    std::ifstream in(previous_results_file);
+    if (!in) {
+        throw std::runtime_error("Failed to open previous results file " + previous_results_file);
+    }
+
+    // JSON is a subset of YAML, so each line is read with the YAML parser.
+    std::string line;
+    for (size_t line_number = 1; std::getline(in, line); line_number++) {
+        if (line.empty()) {
+            continue;
+        }
+        std::string location = previous_results_file + " line " + std::to_string(line_number);
+        YAML::Node result;
+        try {
+            result = YAML::Load(line);
+        } catch (YAML::Exception& e) {
+            throw std::runtime_error("Failed to parse previous results file " + location + ": " + e.what());
+        }
+        if (!result.IsMap() || !result["test"].IsDefined()) {
+            throw std::runtime_error(
+                "Previous results file " + location + " is not a test result written with --format jsonl");
+        }
+        if (!previous_environment.has_value() && result["environment"].IsMap()) {
+            previous_environment.emplace();
+            for (auto value : result["environment"]) {
+                previous_environment->push_back({value.first.as<std::string>(), value.second.as<std::string>()});
+            }
+        }
+        // Results written before per-trial durations were recorded can't be compared.
+        if (result["trial_durations_ns"].IsSequence()) {
+            previous_trial_durations[result["test"].as<std::string>()] =
+                result["trial_durations_ns"].as<std::vector<double>>();
+        }
+    }
+}
+
+void
+regression_check::add(const test_result& result)
+{
+    if (!current_environment.has_value()) {
+        current_environment = result.environment;
+    }
+    auto previous = previous_trial_durations.find(result.name);
+    if (previous == previous_trial_durations.end() || previous->second.empty() || result.trial_durations.empty()) {
+        unmatched_tests.push_back(result.name);
+        return;
+    }
+
+    test_comparison comparison;
+    comparison.name = result.name;
+    comparison.previous_median = _median(previous->second);
+    comparison.current_median = _median(result.trial_durations);
+    comparison.change_percent =
+        comparison.previous_median > 0
+            ? 100 * (comparison.current_median - comparison.previous_median) / comparison.previous_median
+            : 0;
+    comparison.p_value = mann_whitney_u_p_value(previous->second, result.trial_durations);
+    comparison.previous_trials = previous->second.size();
+    comparison.current_trials = result.trial_durations.size();
+    comparison.min_p_value = mann_whitney_u_min_p_value(comparison.previous_trials, comparison.current_trials);
+    comparison.regressed = comparison.p_value <= significance && comparison.change_percent > threshold_percent;
+    comparisons.push_back(comparison);
+}
+
+size_t
+regression_check::report(std::ostream& out) const
+{
+    auto ranked = comparisons;
+    std::stable_sort(
+        ranked.begin(), ranked.end(), [](auto& a, auto& b) { return a.change_percent > b.change_percent; });
+
+    out << "Comparison with " << previous_results_file << " (regression: slower by more than " << threshold_percent
+        << "% with p <= " << significance << ")" << std::endl;
+
+    // Differences in the state of the hosts may explain differences in the results.
+    if (previous_environment.has_value() && current_environment.has_value()) {
+        std::map<std::string, std::string> previous(previous_environment->begin(), previous_environment->end());
+        std::map<std::string, std::string> current(current_environment->begin(), current_environment->end());
+        for (auto& [name, value] : current) {
+            auto previous_value = previous.find(name);
+            if (previous_value == previous.end()) {
+                out << "Environment: " << name << " is " << value << ", previously not recorded" << std::endl;
+            } else if (previous_value->second != value) {
+                out << "Environment: " << name << " changed from " << previous_value->second << " to " << value
+                    << std::endl;
+            }
+        }
+        for (auto& [name, value] : previous) {
+            if (current.find(name) == current.end()) {
+                out << "Environment: " << name << " was " << value << ", now not recorded" << std::endl;
+            }
+        }
+    }
+
+    out << std::setw(10) << "Change" << std::setw(10) << "p-value" << std::setw(15) << "Previous (ns)";
+    out << std::setw(15) << "Current (ns)" << "  Test" << std::endl;
+
+    size_t regressed = 0;
+    for (auto& comparison : ranked) {
+        out << std::setw(10) << _format(comparison.change_percent, 2, true) + "%";
+        out << std::setw(10) << _format(comparison.p_value, 4);
+        out << std::setw(15) << _format(comparison.previous_median, 1);
+        out << std::setw(15) << _format(comparison.current_median, 1);
+        out << "  " << comparison.name;
+        if (comparison.regressed) {
+            out << "  REGRESSED";
+            regressed++;
+        } else if (comparison.p_value <= significance && comparison.change_percent < -threshold_percent) {
+            out << "  improved";
+        }
+        out << std::endl;
+    }
+
+    // Without enough trials no slowdown can be significant, so the test passes whatever its results.
+    for (auto& comparison : comparisons) {
+        if (comparison.min_p_value > significance) {
+            out << "Warning: " << comparison.name << " can't regress, the smallest p-value of "
+                << comparison.previous_trials << " previous and " << comparison.current_trials << " current trials is "
+                << _format(comparison.min_p_value, 4) << ". Run at least 4 trials each, for example with --trials."
+                << std::endl;
+        }
+    }
+
+    for (auto& name : unmatched_tests) {
+        out << "No previous results to compare with for " << name << std::endl;
+    }
+    return regressed;
+}
@@ -0,0 +1,78 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "output.h"
+
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The comparison of one test with its previous results.
+ */
+struct test_comparison
+{
+    std::string name;
+    // Median per-trial duration of the previous and the current results, in nanoseconds.
+    double previous_median = 0;
+    double current_median = 0;
+    // Change of the median duration relative to the previous results, in percent. Slowdowns are positive.
+    double change_percent = 0;
+    // Two-sided p-value of the Mann-Whitney U test of the per-trial durations of both results.
+    double p_value = 1;
+    // Numbers of trials of the previous and the current results, and the smallest p-value they allow, which must be
+    // within the significance for the test to be able to regress.
+    size_t previous_trials = 0;
+    size_t current_trials = 0;
+    double min_p_value = 1;
+    // Whether the test slowed down both significantly and by more than the threshold.
+    bool regressed = false;
+};
+
+/**
+ * @brief Compares the results of each test with those of an earlier run, such as one on the previous version of the
+ * BPF runtime, to catch slowdowns where the results are produced.
+ */
+class regression_check
+{
+  public:
+    /**
+     * @brief Read the previous results.
+     *
+     * @param[in] previous_results_file Results of an earlier run, written with --format jsonl.
+     * @param[in] threshold_percent Smallest slowdown of the median duration, in percent, that counts as a regression.
+     * @param[in] significance Largest p-value at which a slowdown counts as a regression.
+     */
+    regression_check(const std::string& previous_results_file, double threshold_percent, double significance);
+
+    /**
+     * @brief Compare the results of a test with its previous results, if there are any.
+     */
+    void
+    add(const test_result& result);
+
+    /**
+     * @brief Write the differences between the environments of both runs, the comparisons, largest slowdown first,
+     * the tests with too few trials to detect a regression, and the tests without previous results.
+     *
+     * @return The number of tests that regressed.
+     */
+    size_t
+    report(std::ostream& out) const;
+
+  private:
+    std::string previous_results_file;
+    double threshold_percent;
+    double significance;
+    // Test name -> per-trial durations of the previous results.
+    std::map<std::string, std::vector<double>> previous_trial_durations;
+    // Environment of the first result of each run that recorded one.
+    std::optional<environment_fingerprint> previous_environment;
+    std::optional<environment_fingerprint> current_environment;
+    std::vector<test_comparison> comparisons;
+    std::vector<std::string> unmatched_tests;
+};
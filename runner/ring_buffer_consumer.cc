@@ -0,0 +1,161 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "ring_buffer_consumer.h"
+
+#include <bpf/libbpf.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <time.h>
+#endif
+
+// Longest time a polling consumer waits for a wakeup before checking whether it should stop.
+#define RING_BUFFER_POLL_TIMEOUT_MS 10
+
+// Size of the perf buffer of each CPU, in pages. It must be a power of two.
+#define PERF_BUFFER_PAGES 256
+
+ring_buffer_consumer::ring_buffer_consumer(int map_fd, bool perf_event_array, bool busy_poll, std::optional<size_t> cpu)
+    : buffer(nullptr), perf_buffers(nullptr), busy_poll(busy_poll), cpu(cpu), consumed(0), discarding(false)
+{
+#if defined(__linux__)
+    if (perf_event_array) {
+        perf_buffers = perf_buffer__new(map_fd, PERF_BUFFER_PAGES, on_sample, nullptr, this, nullptr);
+        if (!perf_buffers) {
+            throw std::runtime_error(std::string("Failed to open perf buffers: ") + strerror(errno));
+        }
+    } else {
+        buffer = ring_buffer__new(map_fd, on_record, this, nullptr);
+        if (!buffer) {
+            throw std::runtime_error(std::string("Failed to open ring buffer: ") + strerror(errno));
+        }
+    }
+#else
+    (void)map_fd;
+    (void)perf_event_array;
+    throw std::runtime_error("The ring buffer consumer is only supported on Linux");
+#endif
+}
+
+ring_buffer_consumer::~ring_buffer_consumer()
+{
+    if (thread.joinable()) {
+        thread.request_stop();
+        thread.join();
+    }
+#if defined(__linux__)
+    ring_buffer__free(buffer);
+    perf_buffer__free(perf_buffers);
+#endif
+}
+
+void
+ring_buffer_consumer::on_sample(void* context, int cpu, void* data, uint32_t size)
+{
+    (void)cpu;
+    on_record(context, data, size);
+}
+
+int
+ring_buffer_consumer::consume()
+{
+#if defined(__linux__)
+    return perf_buffers ? perf_buffer__consume(perf_buffers) : ring_buffer__consume(buffer);
+#else
+    return 0;
+#endif
+}
+
+int
+ring_buffer_consumer::poll(int timeout_ms)
+{
+#if defined(__linux__)
+    return perf_buffers ? perf_buffer__poll(perf_buffers, timeout_ms) : ring_buffer__poll(buffer, timeout_ms);
+#else
+    (void)timeout_ms;
+    return 0;
+#endif
+}
+
+int
+ring_buffer_consumer::on_record(void* context, void* data, size_t size)
+{
+    auto consumer = static_cast<ring_buffer_consumer*>(context);
+    if (consumer->discarding) {
+        return 0;
+    }
+    consumer->consumed.fetch_add(1, std::memory_order_relaxed);
+
+#if defined(__linux__)
+    // bpf_ktime_get_ns() reads CLOCK_MONOTONIC.
+    uint64_t stamp;
+    if (size >= sizeof(stamp)) {
+        memcpy(&stamp, data, sizeof(stamp));
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t now_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000 + static_cast<uint64_t>(now.tv_nsec);
+        if (stamp != 0 && stamp <= now_ns) {
+            consumer->latency.record(now_ns - stamp);
+        }
+    }
+#endif
+    return 0;
+}
+
+void
+ring_buffer_consumer::start()
+{
+#if defined(__linux__)
+    discarding = true;
+    while (consume() > 0) {
+    }
+    discarding = false;
+    consumed = 0;
+    latency = log_linear_histogram();
+
+    thread = std::jthread([this](std::stop_token stop_token) {
+        if (cpu.has_value()) {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpu.value(), &cpu_set);
+            if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+                std::cerr << "Warning: Failed to pin ring buffer consumer to CPU " << cpu.value() << std::endl;
+            }
+        }
+        while (!stop_token.stop_requested()) {
+            int result = busy_poll ? consume() : poll(RING_BUFFER_POLL_TIMEOUT_MS);
+            // Producers that pass BPF_RB_NO_WAKEUP never signal a wakeup, so read what they wrote on every timeout.
+            if (result == 0 && !busy_poll) {
+                result = consume();
+            }
+            if (result < 0 && result != -EINTR) {
+                std::cerr << "Warning: Failed to read ring buffer: " << strerror(-result) << std::endl;
+                break;
+            }
+        }
+    });
+#endif
+}
+
+ring_buffer_consumer_counts
+ring_buffer_consumer::stop()
+{
+    ring_buffer_consumer_counts counts;
+    counts.consumed_while_running = consumed;
+    thread.request_stop();
+    thread.join();
+#if defined(__linux__)
+    // The producers have stopped, so the buffer only holds the records they left behind.
+    while (consume() > 0) {
+    }
+#endif
+    counts.consumed = consumed;
+    counts.latency = latency;
+    return counts;
+}
@@ -0,0 +1,91 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "histogram.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <thread>
+
+struct perf_buffer;
+struct ring_buffer;
+
+/**
+ * @brief What a ring_buffer_consumer read during one run.
+ */
+struct ring_buffer_consumer_counts
+{
+    // Records read while the producers ran, and in total, including the records left in the buffer when they stopped.
+    uint64_t consumed_while_running = 0;
+    uint64_t consumed = 0;
+    // Time from when a producer stamped each record until it was read, in nanoseconds.
+    log_linear_histogram latency;
+};
+
+/**
+ * @brief Reads the records of a BPF_MAP_TYPE_RINGBUF map, or the samples of a BPF_MAP_TYPE_PERF_EVENT_ARRAY map, on a
+ * thread of its own while the producers of a test run.
+ *
+ * Records that start with a non-zero 64-bit bpf_ktime_get_ns() timestamp are timed from that timestamp until they are
+ * read. The consumer is only supported on Linux.
+ */
+class ring_buffer_consumer
+{
+  public:
+    /**
+     * @brief Open the ring buffer, or the perf buffers of all CPUs.
+     *
+     * @param[in] map_fd File descriptor of the ring buffer or perf event array map.
+     * @param[in] perf_event_array Whether the map is a perf event array.
+     * @param[in] busy_poll Consume in a loop instead of waiting for the producers to signal new records.
+     * @param[in] cpu CPU to pin the consumer to, if any.
+     */
+    ring_buffer_consumer(int map_fd, bool perf_event_array, bool busy_poll, std::optional<size_t> cpu);
+    ring_buffer_consumer(const ring_buffer_consumer&) = delete;
+    ring_buffer_consumer&
+    operator=(const ring_buffer_consumer&) = delete;
+    ~ring_buffer_consumer();
+
+    /**
+     * @brief Discard any records left in the buffer by earlier runs, and start consuming.
+     */
+    void
+    start();
+
+    /**
+     * @brief Stop consuming once the records left in the buffer have been read.
+     *
+     * @return What was read since start was called.
+     */
+    ring_buffer_consumer_counts
+    stop();
+
+  private:
+    static int
+    on_record(void* context, void* data, size_t size);
+
+    static void
+    on_sample(void* context, int cpu, void* data, uint32_t size);
+
+    // Read the records available now, returning the number read or a negative error number.
+    int
+    consume();
+
+    // Wait up to timeout_ms for a wakeup, and read the records it signals.
+    int
+    poll(int timeout_ms);
+
+    ring_buffer* buffer;
+    perf_buffer* perf_buffers;
+    bool busy_poll;
+    std::optional<size_t> cpu;
+    std::jthread thread;
+    // Updated by the consumer thread and read by stop while it still runs.
+    std::atomic<uint64_t> consumed;
+    bool discarding;
+    log_linear_histogram latency;
+};
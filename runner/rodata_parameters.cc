@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "rodata_parameters.h"
+
+#include <bpf/btf.h>
+#include <cstring>
+#include <stdexcept>
+
+rodata_parameters
+parse_rodata_parameters(const YAML::Node& node)
+{
+    if (!node.IsMap()) {
+        throw std::runtime_error("Field parameters must be a map");
+    }
+
+    rodata_parameters parameters;
+    for (auto parameter : node) {
+        auto name = parameter.first.as<std::string>();
+        try {
+            parameters[name] = parameter.second.as<int64_t>();
+        } catch (YAML::Exception&) {
+            throw std::runtime_error("Parameter " + name + " must be an integer");
+        }
+    }
+    return parameters;
+}
+
+std::string
+format_rodata_parameters(const rodata_parameters& parameters)
+{
+    std::string formatted;
+    for (auto& [name, value] : parameters) {
+        formatted += (formatted.empty() ? "" : ";") + name + "=" + std::to_string(value);
+    }
+    return formatted;
+}
+
+// Find the map libbpf creates for the .rodata section. It is named after a prefix of the object name, so it is found
+// by its suffix.
+static bpf_map*
+_find_rodata_map(bpf_object* obj)
+{
+    const std::string suffix = ".rodata";
+    bpf_map* map;
+    bpf_object__for_each_map(map, obj)
+    {
+        std::string name = bpf_map__name(map);
+        if (bpf_map__is_internal(map) && name.size() >= suffix.size() &&
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            return map;
+        }
+    }
+    return nullptr;
+}
+
+void
+write_rodata_parameters(bpf_object* obj, const std::string& elf_file, const rodata_parameters& parameters)
+{
+    if (parameters.empty()) {
+        return;
+    }
+
+    const btf* btf = bpf_object__btf(obj);
+    bpf_map* map = _find_rodata_map(obj);
+    int section_id = btf ? btf__find_by_name_kind(btf, ".rodata", BTF_KIND_DATASEC) : -1;
+    size_t size = 0;
+    auto data = map ? static_cast<uint8_t*>(bpf_map__initial_value(map, &size)) : nullptr;
+    if (section_id < 0 || !data) {
+        throw std::runtime_error("BPF object " + elf_file + " has no read-only globals to set parameters in");
+    }
+
+    const btf_type* section = btf__type_by_id(btf, section_id);
+    for (auto& [name, value] : parameters) {
+        const btf_var_secinfo* variable = btf_var_secinfos(section);
+        uint16_t variable_index = 0;
+        for (; variable_index < btf_vlen(section); variable_index++, variable++) {
+            const btf_type* type = btf__type_by_id(btf, variable->type);
+            if (type && name == btf__name_by_offset(btf, type->name_off)) {
+                break;
+            }
+        }
+        if (variable_index == btf_vlen(section)) {
+            throw std::runtime_error("BPF object " + elf_file + " has no read-only global named " + name);
+        }
+
+        // The variable's type is const volatile, which resolving strips.
+        const btf_type* type = btf__type_by_id(btf, btf__resolve_type(btf, btf__type_by_id(btf, variable->type)->type));
+        if (!type || (btf_kind(type) != BTF_KIND_INT && btf_kind(type) != BTF_KIND_ENUM) ||
+            variable->size > sizeof(value) || variable->offset + variable->size > size) {
+            throw std::runtime_error("Read-only global " + name + " of BPF object " + elf_file + " is not an integer");
+        }
+
+        // Accept any value that fits the variable either as a signed or as an unsigned integer.
+        if (variable->size < sizeof(value)) {
+            int64_t limit = int64_t{1} << (variable->size * 8);
+            if (value < -limit / 2 || value >= limit) {
+                throw std::runtime_error(
+                    "Parameter " + name + " value " + std::to_string(value) + " does not fit in a " +
+                    std::to_string(variable->size) + "-byte integer");
+            }
+        }
+
+        // The host and the BPF programs are little-endian, so the low-order bytes of the value come first.
+        memcpy(data + variable->offset, &value, variable->size);
+    }
+}
@@ -0,0 +1,45 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <bpf/libbpf.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <yaml-cpp/yaml.h>
+
+/**
+ * @brief Values of the read-only globals of a BPF object, declared const volatile in the program, by variable name.
+ *
+ * The values are written into the .rodata section before the object is loaded, so the verifier sees them as constants
+ * and can prune the branches they rule out.
+ */
+typedef std::map<std::string, int64_t> rodata_parameters;
+
+/**
+ * @brief Parse the parameters field of a test, a map of global variable names to integer values.
+ *
+ * @param[in] node The parameters node.
+ * @return The parameters.
+ * @throw std::runtime_error if the node is not a map of integers.
+ */
+rodata_parameters
+parse_rodata_parameters(const YAML::Node& node);
+
+/**
+ * @brief Format parameters as name=value pairs separated by semicolons, in name order.
+ */
+std::string
+format_rodata_parameters(const rodata_parameters& parameters);
+
+/**
+ * @brief Write parameters into the .rodata section of a BPF object that has been opened but not yet loaded.
+ *
+ * @param[in] obj The BPF object.
+ * @param[in] elf_file Path to the ELF file the object was opened from, for error messages.
+ * @param[in] parameters The parameters.
+ * @throw std::runtime_error if the object has no integer read-only global for a parameter, or its value does not fit.
+ */
+void
+write_rodata_parameters(bpf_object* obj, const std::string& elf_file, const rodata_parameters& parameters);
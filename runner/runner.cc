@@ -1,27 +1,64 @@
 // Copyright (c) Microsoft Corporation
 // SPDX-License-Identifier: MIT
 
+#include "cpu_topology.h"
+#include "environment.h"
+#include "histogram.h"
+#include "map_operations.h"
+#include "map_population.h"
+#include "map_snapshot.h"
 #include "options.h"
+#include "output.h"
+#include "perf_counters.h"
+#include "pin_cache.h"
+#include "regression.h"
+#include "rodata_parameters.h"
+#include "ring_buffer_consumer.h"
+#include "statistics.h"
+#include "test_matrix.h"
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
 #include <bpf/bpf.h>
 #include <bpf/libbpf.h>
 #include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <optional>
 #include <regex>
 #include <sstream>
 #include <thread>
+#include <tuple>
 #include <vector>
 #include <yaml-cpp/yaml.h>
 
 #if defined(__linux__)
 #include <linux/bpf.h>
+#include <sched.h>
 // Define BPF_F_TEST_XDP_LIVE_FRAMES if not already defined
 #ifndef BPF_F_TEST_XDP_LIVE_FRAMES
 #define BPF_F_TEST_XDP_LIVE_FRAMES (1U << 1)
 #endif
+#else
+#define NOMINMAX
+#include <windows.h>
 #endif
 
+// A test regresses if it is slower than its previous results by more than the threshold, and the Mann-Whitney U test
+// of the per-trial durations finds the difference significant at this level.
+#define DEFAULT_REGRESSION_THRESHOLD_PERCENT 5
+#define REGRESSION_SIGNIFICANCE 0.05
+
+// Returned by a program that feeds a ring buffer consumer when its record was dropped because the buffer was full.
+// Drops are reported in the drop rate, so this result is accepted from tests with a consumer.
+#define RING_BUFFER_FULL_RESULT 2
+
 // Define unique_ptr to call bpf_object__close on destruction
 struct bpf_object_deleter
 {
@@ -41,8 +78,66 @@ struct bpf_object_info
 {
     bpf_object_ptr obj;
     bpf_prog_type prog_type;
+    // Set if the object was reused from the pinned-object cache, in which case obj is opened but not loaded.
+    pinned_object_ptr pinned;
+    // Contents of the maps right after the object was loaded.
+    map_snapshot initial_state;
 };
 
+// Get the file descriptor of the named program in a BPF object.
+std::optional<int>
+find_program_fd(const bpf_object_info& obj_info, const std::string& program_name)
+{
+    if (obj_info.pinned) {
+        auto program_fd = obj_info.pinned->program_fds.find(program_name);
+        if (program_fd == obj_info.pinned->program_fds.end()) {
+            return {};
+        }
+        return program_fd->second;
+    }
+
+    auto program = bpf_object__find_program_by_name(obj_info.obj.get(), program_name.c_str());
+    if (!program) {
+        return {};
+    }
+    return bpf_program__fd(program);
+}
+
+// Get the file descriptor of the named map in a BPF object.
+std::optional<int>
+find_map_fd(const bpf_object_info& obj_info, const std::string& map_name)
+{
+    if (obj_info.pinned) {
+        auto map_fd = obj_info.pinned->map_fds.find(map_name);
+        if (map_fd == obj_info.pinned->map_fds.end()) {
+            return {};
+        }
+        return map_fd->second;
+    }
+
+    auto map = bpf_object__find_map_by_name(obj_info.obj.get(), map_name.c_str());
+    if (!map) {
+        return {};
+    }
+    return bpf_map__fd(map);
+}
+
+// Get every map of a BPF object together with the file descriptor to access it through.
+std::vector<std::pair<bpf_map*, int>>
+object_maps(const bpf_object_info& obj_info)
+{
+    std::vector<std::pair<bpf_map*, int>> maps;
+    bpf_map* map;
+    bpf_object__for_each_map(map, obj_info.obj.get())
+    {
+        auto map_fd = find_map_fd(obj_info, bpf_map__name(map));
+        if (map_fd.has_value()) {
+            maps.push_back({map, map_fd.value()});
+        }
+    }
+    return maps;
+}
+
 // Set string runner_platform to "linux" to indicate that this is a Linux runner.
 #if defined(__linux__)
 const std::string runner_platform = "Linux";
@@ -52,6 +147,7 @@ const std::string runner_platform = "Linux";
 #define DEFAULT_PASS_DATA true
 #define DEFAULT_PASS_CONTEXT false
 #define DEFAULT_BATCH_SIZE 0
+#define DEFAULT_SLICE_ITERATION_COUNT 10000
 #else
 const std::string runner_platform = "Windows";
 #define popen _popen
@@ -62,6 +158,7 @@ const std::string runner_platform = "Windows";
 #define DEFAULT_PASS_DATA false
 #define DEFAULT_PASS_CONTEXT true
 #define DEFAULT_BATCH_SIZE 64
+#define DEFAULT_SLICE_ITERATION_COUNT 10000
 #endif
 
 int run_command_and_capture_output(const std::string& command, std::string& command_output)
@@ -91,18 +188,649 @@ std::string to_iso8601(const std::chrono::system_clock::time_point tp)
     return ss.str();
 }
 
+// Settings for a single test, parsed from the YAML file with the command line overrides applied.
+struct test_configuration
+{
+    std::string name;
+    std::string group;
+    // Matrix dimension -> value, for tests expanded from a matrix.
+    std::vector<std::pair<std::string, std::string>> parameters;
+    std::string elf_file;
+    // Values written into the read-only globals of the object before it is loaded.
+    rodata_parameters global_parameters;
+    int iteration_count;
+    std::optional<std::string> program_type;
+    int batch_size;
+    bool pass_data;
+    bool pass_context;
+    uint32_t expected_result;
+    int trials;
+    int warmup;
+    std::optional<int> target_duration_ms;
+    std::optional<double> min_overlap_percent;
+    std::optional<double> duration_seconds;
+    int slice_iteration_count;
+    bool histogram;
+    bool perf_counters;
+    bool scaling_sweep;
+    std::optional<std::string> map_state_preparation_program;
+    int map_state_preparation_iteration_count;
+    std::vector<map_population> map_populations;
+    // Map to run map operations against from user space. When set, program_cpu_assignment assigns map operations
+    // instead of programs.
+    std::optional<std::string> operation_map;
+    // Ring buffer or perf event array map to read on a consumer thread while the programs run, how to wait for
+    // records, and where.
+    std::optional<std::string> ring_buffer_consumer_map;
+    bool ring_buffer_consumer_busy_poll;
+    std::optional<size_t> ring_buffer_consumer_cpu;
+    YAML::Node program_cpu_assignment;
+
+    // Resolved once the BPF object has been loaded.
+    bpf_prog_type prog_type;
+    bpf_object_info* object;
+    std::vector<int> map_population_fds;
+    std::optional<int> map_state_preparation_program_fd;
+    bpf_map* operation_map_object;
+    std::optional<int> operation_map_fd;
+    std::optional<int> ring_buffer_consumer_map_fd;
+    bool ring_buffer_consumer_perf_event_array;
+    // Vector of CPU -> program fd, or map_operation_kind for tests with an operation_map.
+    std::vector<std::optional<int>> cpu_program_assignments;
+    // CPUs whose program was assigned with "all" or "remaining", in CPU order. A scaling sweep varies how many of
+    // these run.
+    std::vector<size_t> sweep_cpus;
+    // Program fd -> program name.
+    std::map<int, std::string> program_names;
+};
+
+// Settings of the baseline program, whose duration is subtracted from the durations of the tests to remove the
+// overhead of the test harness.
+struct baseline_configuration
+{
+    std::string elf_file;
+    std::string program;
+    int iteration_count;
+    int trials;
+};
+
+// Convert an optional libbpf program type name to a program type, using DEFAULT_PROG_TYPE if none is given.
+bpf_prog_type
+resolve_program_type(const std::optional<std::string>& program_type)
+{
+    if (!program_type.has_value()) {
+        return DEFAULT_PROG_TYPE;
+    }
+    bpf_prog_type prog_type;
+    bpf_attach_type attach_type;
+    if (libbpf_prog_type_by_name(program_type->c_str(), &prog_type, &attach_type) < 0) {
+        throw std::runtime_error("Failed to get program type " + *program_type);
+    }
+    return prog_type;
+}
+
+// A BPF object to load: the ELF file, the program type to load its programs as and the values of its read-only globals.
+struct bpf_object_request
+{
+    std::string elf_file;
+    bpf_prog_type prog_type;
+    rodata_parameters global_parameters;
+};
+
+// Name a loaded BPF object. The same ELF file loaded with different parameters is a different object.
+std::string
+object_key(const std::string& elf_file, const rodata_parameters& global_parameters)
+{
+    if (global_parameters.empty()) {
+        return elf_file;
+    }
+    return elf_file + " (" + format_rodata_parameters(global_parameters) + ")";
+}
+
+// Open the BPF object in elf_file, set every program in it to prog_type, write the parameters into its read-only
+// globals and load it.
+// If a pinned-object cache is given, the programs and maps are reused from it when present and added to it otherwise.
+bpf_object_info
+load_bpf_object(
+    const std::string& elf_file,
+    bpf_prog_type prog_type,
+    const std::optional<pin_cache>& cache,
+    const rodata_parameters& global_parameters = {})
+{
+    bpf_object_info obj_info;
+    obj_info.prog_type = prog_type;
+    bpf_object_ptr& obj = obj_info.obj;
+
+    obj.reset(bpf_object__open(elf_file.c_str()));
+    if (!obj) {
+        throw std::runtime_error(
+            "Failed to open BPF object " + elf_file + ": " + strerror(errno) + "/" + std::to_string(errno));
+    }
+
+    bpf_program* program;
+    bpf_object__for_each_program(program, obj.get())
+    {
+        (void)bpf_program__set_type(program, prog_type);
+    }
+
+    write_rodata_parameters(obj.get(), elf_file, global_parameters);
+    std::string formatted_parameters = format_rodata_parameters(global_parameters);
+
+    if (cache.has_value()) {
+        obj_info.pinned = cache->lookup(elf_file, prog_type, formatted_parameters, obj.get());
+        if (obj_info.pinned) {
+            return obj_info;
+        }
+    }
+
+    if (bpf_object__load(obj.get()) < 0) {
+        throw std::runtime_error(
+            "Failed to load BPF object " + elf_file + ": " + strerror(errno) + "/" + std::to_string(errno));
+    }
+
+    if (cache.has_value()) {
+        // The cache only saves time on later runs, so failing to add to it doesn't fail this one.
+        try {
+            cache->store(elf_file, prog_type, formatted_parameters, obj.get());
+        } catch (std::exception& e) {
+            std::cerr << "Warning: Failed to add " << elf_file << " to the pinned-object cache: " << e.what()
+                      << std::endl;
+        }
+    }
+
+    return obj_info;
+}
+
+// Load the given BPF objects concurrently on a pool of worker threads, so that the verifier cost of the objects
+// overlaps instead of being paid serially between measurements.
+// If any object fails to load, the error of the first failing object in the given order is thrown. The loaded objects
+// are returned by object_key.
+std::map<std::string, bpf_object_info>
+load_bpf_objects(const std::vector<bpf_object_request>& objects, const std::optional<pin_cache>& cache)
+{
+    std::vector<bpf_object_info> loaded_objects(objects.size());
+    std::vector<std::exception_ptr> errors(objects.size());
+    std::atomic<size_t> next_object = 0;
+
+    size_t thread_count = std::min<size_t>(objects.size(), std::max(std::thread::hardware_concurrency(), 1u));
+    {
+        std::vector<std::jthread> threads;
+        for (size_t i = 0; i < thread_count; i++) {
+            threads.emplace_back([&]() {
+                for (size_t index = next_object++; index < objects.size(); index = next_object++) {
+                    try {
+                        auto& object = objects[index];
+                        loaded_objects[index] =
+                            load_bpf_object(object.elf_file, object.prog_type, cache, object.global_parameters);
+                    } catch (...) {
+                        errors[index] = std::current_exception();
+                    }
+                }
+            });
+        }
+    }
+
+    std::map<std::string, bpf_object_info> bpf_objects;
+    for (size_t i = 0; i < objects.size(); i++) {
+        if (errors[i]) {
+            std::rethrow_exception(errors[i]);
+        }
+        bpf_objects.insert(
+            {object_key(objects[i].elf_file, objects[i].global_parameters), std::move(loaded_objects[i])});
+    }
+    return bpf_objects;
+}
+
+// Parameters shared by every bpf_prog_test_run_opts call made for a test.
+struct test_run_parameters
+{
+    int iteration_count;
+    int batch_size;
+    bool pass_data;
+    bool pass_context;
+    bpf_prog_type prog_type;
+    // When set, each CPU repeatedly runs slices of slice_iteration_count iterations until this much time has elapsed,
+    // instead of a single run of iteration_count iterations.
+    std::optional<std::chrono::nanoseconds> run_duration;
+    int slice_iteration_count;
+    // When set, runs are always split into slices of slice_iteration_count iterations and the mean per-iteration
+    // duration of every slice is recorded in a histogram.
+    bool record_histogram;
+    // When set, hardware performance counters are recorded on each CPU for the duration of the run.
+    bool record_perf_counters;
+    // When set, each CPU runs the map operation assigned to it against this map instead of a program, and an
+    // iteration is one element processed by the operation.
+    std::shared_ptr<const map_operation_target> map_operation;
+};
+
+// Pin the calling thread to the given CPU. Returns false if the CPU is not available to this process.
+bool
+pin_current_thread_to_cpu(size_t cpu)
+{
+#if defined(__linux__)
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    return sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+#else
+    if (cpu >= sizeof(DWORD_PTR) * 8) {
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu) != 0;
+#endif
+}
+
+// Result of running a program on one CPU.
+struct cpu_run_result
+{
+    // Options of the last bpf_prog_test_run_opts call. The duration is replaced by the mean per-iteration duration
+    // across all calls made for the run.
+    bpf_test_run_opts opts;
+    // Total number of iterations run and the sum of their kernel-reported durations.
+    uint64_t operation_count;
+    uint64_t total_duration_ns;
+    // Wall-clock interval spanned by the bpf_prog_test_run_opts calls.
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point end_time;
+    // Mean per-iteration duration of each slice, in nanoseconds, when recording histograms.
+    log_linear_histogram slice_durations;
+    // Hardware performance counters for the run, when recording them.
+    perf_counter_values perf_counters;
+    // Negative error number of the bpf_prog_test_run_opts call or map operation that failed and ended the run, or 0.
+    int error;
+};
+
+// Fill in the bpf_test_run_opts for running a test program on the given CPU.
+void
+initialize_test_run_opts(
+    bpf_test_run_opts& opt,
+    const test_run_parameters& parameters,
+    size_t cpu,
+    int repeat,
+    std::vector<uint8_t>& data_in,
+    std::vector<uint8_t>& data_out)
+{
+    memset(&opt, 0, sizeof(opt));
+    opt.sz = sizeof(opt);
+    opt.repeat = repeat;
+    opt.cpu = static_cast<uint32_t>(cpu);
+    if (parameters.pass_data) {
+        opt.data_in = data_in.data();
+        opt.data_out = data_out.data();
+        opt.data_size_in = static_cast<uint32_t>(data_in.size());
+        opt.data_size_out = static_cast<uint32_t>(data_out.size());
+    }
+    if (parameters.pass_context) {
+        opt.ctx_in = data_in.data();
+        opt.ctx_out = data_out.data();
+        opt.ctx_size_in = static_cast<uint32_t>(data_in.size());
+        opt.ctx_size_out = static_cast<uint32_t>(data_out.size());
+    }
+#if defined(HAS_BPF_TEST_RUN_OPTS_BATCH_SIZE)
+    opt.batch_size = parameters.batch_size;
+#endif
+#if defined(HAS_BPF_TEST_RUN_OPTS_FLAGS) && defined(__linux__)
+    // Set BPF_F_TEST_XDP_LIVE_FRAMES flag for XDP programs on Linux
+    if (parameters.prog_type == BPF_PROG_TYPE_XDP) {
+        opt.flags |= BPF_F_TEST_XDP_LIVE_FRAMES;
+    }
+#endif
+}
+
+// Run each assigned program on its CPU via bpf_prog_test_run_opts, one thread per CPU. For map operation tests, each
+// thread instead runs its map operation through the bpf() syscall and times it with the wall clock.
+// Each thread is pinned to its CPU and waits on a barrier until every thread is ready, so that concurrent programs
+// contend with each other for the whole run rather than starting one by one.
+// In duration mode the calling thread stops all workers together once the duration has elapsed; the workers check
+// their stop token between slices. In histogram mode fixed-count runs are also split into slices.
+// Returns one cpu_run_result per CPU; entries for CPUs without a program are left zeroed.
+std::vector<cpu_run_result>
+run_programs_on_cpus(
+    const std::vector<std::optional<int>>& cpu_program_assignments, const test_run_parameters& parameters)
+{
+    std::vector<std::jthread> threads;
+    std::vector<cpu_run_result> results(cpu_program_assignments.size());
+    std::ptrdiff_t thread_count = std::count_if(
+        cpu_program_assignments.begin(), cpu_program_assignments.end(), [](auto& program) {
+            return program.has_value();
+        });
+    // The calling thread also waits on the barrier so the duration is timed from when all workers are ready.
+    std::barrier start_barrier(thread_count + 1);
+    bool sliced = parameters.run_duration.has_value() || parameters.record_histogram;
+    uint64_t iteration_count = static_cast<uint64_t>(std::max(parameters.iteration_count, 1));
+    size_t worker_index = 0;
+
+    for (size_t i = 0; i < cpu_program_assignments.size(); i++) {
+        auto& result = results[i];
+        memset(&result.opts, 0, sizeof(result.opts));
+        result.operation_count = 0;
+        result.total_duration_ns = 0;
+        if (!cpu_program_assignments[i].has_value()) {
+            continue;
+        }
+        auto program = cpu_program_assignments[i].value();
+        size_t index = worker_index++;
+
+        threads.emplace_back([=, &result, &start_barrier](std::stop_token stop_token) {
+            auto& opt = result.opts;
+            std::vector<uint8_t> data_in(1024);
+            std::vector<uint8_t> data_out(1024);
+
+            if (!pin_current_thread_to_cpu(i)) {
+                std::cerr << "Warning: Failed to pin thread to CPU " << i << std::endl;
+            }
+
+            // Map operation workers start at different keys so that they spread across the map. They are created after
+            // pinning so that their buffers are local to the CPU.
+            std::optional<map_operation_worker> map_worker;
+            if (parameters.map_operation) {
+                map_worker.emplace(
+                    parameters.map_operation, static_cast<map_operation_kind>(program), index, thread_count);
+            }
+
+            // Open the counters before the barrier so that only the runs themselves are counted.
+            std::optional<perf_counter_set> perf_counters;
+            if (parameters.record_perf_counters) {
+                perf_counters.emplace();
+            }
+
+            start_barrier.arrive_and_wait();
+
+            if (perf_counters.has_value()) {
+                perf_counters->start();
+            }
+            result.start_time = std::chrono::steady_clock::now();
+            for (;;) {
+                int repeat = parameters.iteration_count;
+                if (sliced) {
+                    repeat = parameters.slice_iteration_count;
+                    if (!parameters.run_duration.has_value()) {
+                        repeat = static_cast<int>(
+                            std::min<uint64_t>(repeat, iteration_count - result.operation_count));
+                    }
+                }
+
+                initialize_test_run_opts(opt, parameters, i, repeat, data_in, data_out);
+                int error;
+                uint64_t completed = repeat;
+                if (map_worker.has_value()) {
+                    auto slice_start = std::chrono::steady_clock::now();
+                    error = map_worker->run(repeat, completed);
+                    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - slice_start);
+                    opt.duration = completed > 0 ? static_cast<uint32_t>(elapsed.count() / completed) : 0;
+                } else {
+                    error = bpf_prog_test_run_opts(program, &opt);
+                }
+                if (error < 0) {
+                    opt.retval = error;
+                    result.error = error;
+                    break;
+                }
+                result.operation_count += completed;
+                result.total_duration_ns += static_cast<uint64_t>(opt.duration) * completed;
+                if (parameters.record_histogram && completed > 0) {
+                    result.slice_durations.record(opt.duration);
+                }
+
+                // A map operation that found nothing left to process has emptied the map.
+                if (completed == 0 && !parameters.run_duration.has_value()) {
+                    break;
+                }
+
+                bool done = parameters.run_duration.has_value() ? stop_token.stop_requested()
+                                                                : result.operation_count >= iteration_count;
+                if (done) {
+                    break;
+                }
+            }
+            result.end_time = std::chrono::steady_clock::now();
+            if (perf_counters.has_value()) {
+                perf_counters->stop();
+                result.perf_counters = perf_counters->read();
+            }
+
+            if (result.operation_count > 0) {
+                opt.duration = static_cast<uint32_t>(result.total_duration_ns / result.operation_count);
+            }
+        });
+    }
+
+    start_barrier.arrive_and_wait();
+    if (parameters.run_duration.has_value()) {
+        std::this_thread::sleep_for(parameters.run_duration.value());
+        for (auto& thread : threads) {
+            thread.request_stop();
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return results;
+}
+
+// Compute the number of iterations per second completed by a CPU during its run.
+double
+compute_operations_per_second(const cpu_run_result& result)
+{
+    double seconds = std::chrono::duration<double>(result.end_time - result.start_time).count();
+    return seconds > 0 ? static_cast<double>(result.operation_count) / seconds : 0;
+}
+
+// Compute the fraction of the run, in percent, during which all CPUs were running their programs at the same time.
+// This is the interval from the last start to the first end, divided by the interval from the first start to the
+// last end. A run on a single CPU fully overlaps with itself.
+double
+compute_overlap_percent(
+    const std::vector<std::optional<int>>& cpu_program_assignments, const std::vector<cpu_run_result>& results)
+{
+    std::optional<std::chrono::steady_clock::time_point> first_start, last_start, first_end, last_end;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (!cpu_program_assignments[i].has_value()) {
+            continue;
+        }
+        auto& result = results[i];
+        first_start = first_start.has_value() ? std::min(*first_start, result.start_time) : result.start_time;
+        last_start = last_start.has_value() ? std::max(*last_start, result.start_time) : result.start_time;
+        first_end = first_end.has_value() ? std::min(*first_end, result.end_time) : result.end_time;
+        last_end = last_end.has_value() ? std::max(*last_end, result.end_time) : result.end_time;
+    }
+
+    if (!first_start.has_value() || *last_end <= *first_start) {
+        return 100;
+    }
+
+    auto overlap = std::max(*first_end - *last_start, std::chrono::steady_clock::duration::zero());
+    return 100.0 * std::chrono::duration<double>(overlap).count() /
+           std::chrono::duration<double>(*last_end - *first_start).count();
+}
+
+// Compute the wall-clock time in seconds from when the first CPU started running its program until the last one
+// finished.
+double
+compute_run_seconds(
+    const std::vector<std::optional<int>>& cpu_program_assignments, const std::vector<cpu_run_result>& results)
+{
+    std::optional<std::chrono::steady_clock::time_point> first_start, last_end;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (!cpu_program_assignments[i].has_value()) {
+            continue;
+        }
+        first_start = first_start.has_value() ? std::min(*first_start, results[i].start_time) : results[i].start_time;
+        last_end = last_end.has_value() ? std::max(*last_end, results[i].end_time) : results[i].end_time;
+    }
+    if (!first_start.has_value()) {
+        return 0;
+    }
+    return std::chrono::duration<double>(*last_end - *first_start).count();
+}
+
+// Probes shorter than this are too coarse to calibrate from, so the repeat count is grown until a probe is longer.
+#define CALIBRATION_MINIMUM_PROBE_DURATION std::chrono::milliseconds(10)
+#define CALIBRATION_INITIAL_ITERATION_COUNT 1000
+#define CALIBRATION_GROWTH_FACTOR 10
+
+// Pick an iteration count so that a single run of the test takes approximately target_duration.
+// Probes run the programs on the same CPUs as the test itself, so contention between CPUs is accounted for, and the
+// slowest CPU determines the count. The result of each probe on each CPU is passed to check_result, which throws if
+// the probe failed, as a failed probe reports no duration.
+int
+calibrate_iteration_count(
+    const std::vector<std::optional<int>>& cpu_program_assignments,
+    test_run_parameters parameters,
+    std::chrono::nanoseconds target_duration,
+    const std::function<void(size_t, const cpu_run_result&)>& check_result)
+{
+    const int64_t max_iteration_count = std::numeric_limits<int>::max();
+    int64_t iteration_count = CALIBRATION_INITIAL_ITERATION_COUNT;
+    parameters.record_perf_counters = false;
+
+    for (;;) {
+        parameters.iteration_count = static_cast<int>(iteration_count);
+        auto results = run_programs_on_cpus(cpu_program_assignments, parameters);
+
+        // The kernel reports the mean duration of one iteration, truncated to whole nanoseconds.
+        uint32_t slowest_duration = 0;
+        for (size_t i = 0; i < results.size(); i++) {
+            if (cpu_program_assignments[i].has_value()) {
+                check_result(i, results[i]);
+                slowest_duration = std::max(slowest_duration, results[i].opts.duration);
+            }
+        }
+
+        std::chrono::nanoseconds probe_duration(iteration_count * slowest_duration);
+        if (probe_duration >= CALIBRATION_MINIMUM_PROBE_DURATION || iteration_count >= max_iteration_count) {
+            int64_t calibrated_count = target_duration.count() / std::max<uint32_t>(slowest_duration, 1);
+            return static_cast<int>(std::clamp<int64_t>(calibrated_count, 1, max_iteration_count));
+        }
+
+        iteration_count = std::min(iteration_count * CALIBRATION_GROWTH_FACTOR, max_iteration_count);
+    }
+}
+
+#define DEFAULT_BASELINE_ITERATION_COUNT 1000000
+#define DEFAULT_BASELINE_TRIALS 10
+
+// Run the baseline program at once on the CPUs that have a program in the given assignments, for the given number of
+// trials after one discarded warmup run, and return the mean per-iteration duration of each trial on each of those
+// CPUs. Running on the same CPUs as the test keeps the contention on shared resources, such as the SMT sibling of a
+// CPU, the same for both.
+// The program type, data, context and batch size of the parameters are those of the tests that the baseline is for,
+// as they change what the harness does around each iteration.
+std::vector<std::vector<double>>
+measure_baseline(
+    int program_fd,
+    const std::vector<std::optional<int>>& test_cpu_program_assignments,
+    test_run_parameters parameters,
+    int trials)
+{
+    parameters.run_duration.reset();
+    parameters.record_histogram = false;
+    parameters.record_perf_counters = false;
+    parameters.map_operation.reset();
+    std::vector<std::optional<int>> cpu_program_assignments(test_cpu_program_assignments.size());
+    for (size_t i = 0; i < test_cpu_program_assignments.size(); i++) {
+        if (test_cpu_program_assignments[i].has_value()) {
+            cpu_program_assignments[i] = program_fd;
+        }
+    }
+
+    std::vector<std::vector<double>> cpu_durations(cpu_program_assignments.size());
+    for (int run = 0; run <= trials; run++) {
+        auto results = run_programs_on_cpus(cpu_program_assignments, parameters);
+        for (size_t i = 0; i < results.size(); i++) {
+            if (!cpu_program_assignments[i].has_value()) {
+                continue;
+            }
+            if (results[i].operation_count == 0) {
+                throw std::runtime_error(
+                    "Failed to run baseline program on CPU " + std::to_string(i) + ": " +
+                    strerror(-static_cast<int>(results[i].opts.retval)));
+            }
+            if (run > 0) {
+                cpu_durations[i].push_back(static_cast<double>(results[i].opts.duration));
+            }
+        }
+    }
+    return cpu_durations;
+}
+
+// Get the points of a scaling sweep over the given number of CPUs: 1, 2, 4, ... and finally the count itself.
+std::vector<size_t>
+scaling_sweep_points(size_t sweep_cpu_count)
+{
+    std::vector<size_t> points;
+    for (size_t point = 1; point < sweep_cpu_count; point *= 2) {
+        points.push_back(point);
+    }
+    points.push_back(sweep_cpu_count);
+    return points;
+}
+
+// Get the CPU assignments of a test at one point of a scaling sweep. Only the first sweep_cpu_count of the CPUs
+// assigned with "all" or "remaining" keep their program; CPUs assigned explicitly always keep theirs.
+std::vector<std::optional<int>>
+sweep_cpu_program_assignments(const test_configuration& test, size_t sweep_cpu_count)
+{
+    auto cpu_program_assignments = test.cpu_program_assignments;
+    for (size_t i = sweep_cpu_count; i < test.sweep_cpus.size(); i++) {
+        cpu_program_assignments[test.sweep_cpus[i]].reset();
+    }
+    return cpu_program_assignments;
+}
+
 // This program runs a set of BPF programs and reports the average execution time for each program.
 // It reads a YAML file that contains the following fields:
+// - baseline: optional, a program whose duration is subtracted from those of the tests to remove the overhead of the
+//   test harness
+//   - elf_file: the path to the BPF object file
+//   - program: the name of the program
+//   - iteration_count: optional, the number of times to run the program per trial (default 1000000)
+//   - trials: optional, the number of measured runs on each CPU (default 10)
 // - tests: a list of tests to run
 //   - name: the name of the test
+//   - group: optional, a name shared by related tests for grouping their results (default the test name)
+//   - matrix: optional, a map of variable names to lists of values; the test is expanded into one test per combination
+//     of values, with ${variable} in any field replaced by its value
 //   - elf_file: the path to the BPF object file
+//   - parameters: optional, a map of const volatile global variable names to the integer values to load the object
+//     with; the object is loaded once for each set of parameters
 //   - iteration_count: the number of times to run each program
+//   - target_duration_ms: optional, calibrate the iteration count so that each run takes about this long
+//   - min_overlap_percent: optional, fail the test if its CPUs ran concurrently for less than this share of a trial
+//   - duration_seconds: optional, run each trial for this long in slices instead of for iteration_count iterations
+//   - slice_iteration_count: optional, the number of iterations per bpf_prog_test_run_opts call when run in slices
+//   - histogram: optional, run in slices and report percentiles of the per-slice mean durations
+//   - perf_counters: optional, report hardware performance counters per operation
+//   - scaling_sweep: optional, run the test on 1, 2, 4, ... of the CPUs assigned with "all" or "remaining"
+//   - trials: optional, the number of measured runs of the test, summarized in the output (default 1)
+//   - warmup: optional, the number of runs to perform and discard before the measured trials (default 0)
+//   - map_population: optional, a list of maps to fill with generated elements before the test
+//     - map: the name of the map
+//     - count: the number of elements to write
+//     - key: a generator for the key, or a map of key field names to generators
+//     - value: optional, a generator for the value, or a map of value field names to generators
 //   - map_state_preparation: optional, a program to run before the test to prepare the map state
 //     - program: the name of the program
 //     - iteration_count: the number of times to run the program
-//   - program_cpu_assignment: a map of program names to CPUs
-//     - <program name>: the name of the program
-//       - <cpu number>: the CPU number to run the program on
+//   - ring_buffer_consumer: optional, read a ring buffer or perf event array on a consumer thread while the programs
+//     run
+//     - map: the name of the BPF_MAP_TYPE_RINGBUF or BPF_MAP_TYPE_PERF_EVENT_ARRAY map
+//     - busy_poll: optional, consume in a loop instead of waiting for wakeups (default false)
+//     The programs return RING_BUFFER_FULL_RESULT when the buffer was full, which is counted as a drop
+//     - cpu: optional, the CPU to run the consumer on
+//   - operation_map: optional, the name of a map to run map operations against from user space instead of programs
+//   - batch_size: optional, the batch size of bpf_prog_test_run_opts, or the elements per call of batch map operations
+//   - program_cpu_assignment: a map of program names, or map operations for tests with an operation_map, to CPUs
+//     - <program name>: the name of the program, or one of the map operations lookup, update, delete,
+//       lookup_and_delete, get_next_key, lookup_batch, update_batch, delete_batch and lookup_and_delete_batch
+//       - <cpu selector>: the CPUs to run the program on, or a list of them
+//         - <cpu number>: a single CPU
+//         - <first>-<last>: a range of CPUs, such as 0-15
+//         - node:<n>, socket:<n>: the CPUs of a NUMA node or socket
+//         - smt_siblings_of:<cpu number>: a CPU and the CPUs that share its core
+//         - one_per_core: the first CPU of each core
+//         - cross_node_pairs: as many CPUs from each of the first two NUMA nodes, one per core
 //       - all: run the program on all CPUs
 //       - remaining: run the program on all remaining CPUs
 int
@@ -116,12 +844,30 @@ main(int argc, char** argv)
         std::optional<std::string> test_name;
         std::optional<int> batch_size_override;
         std::optional<std::string> ebpf_file_extension_override;
+        std::optional<std::string> variant;
         std::optional<int> iteration_count_override;
         std::optional<int> cpu_count_override;
+        std::optional<int> trials_override;
+        std::optional<int> warmup_override;
+        std::optional<int> target_duration_ms_override;
+        std::optional<double> min_overlap_percent_override;
+        std::optional<double> duration_seconds_override;
+        std::optional<bool> histogram_override;
+        std::optional<bool> perf_counters_override;
+        std::optional<bool> scaling_sweep_override;
         std::optional<bool> ignore_return_code;
         std::optional<std::string> pre_test_command;
         std::optional<std::string> post_test_command;
-        bool csv_header_printed = false;
+        bool validate_only = false;
+        std::optional<pin_cache> cache;
+        std::string pin_cache_directory = DEFAULT_PIN_CACHE_DIRECTORY;
+        bool use_pin_cache = false;
+        bool purge_pin_cache = false;
+        std::string output_format = "csv";
+        std::optional<std::string> output_file;
+        std::optional<std::string> previous_results_file;
+        std::optional<std::string> preflight;
+        double regression_threshold_percent = DEFAULT_REGRESSION_THRESHOLD_PERCENT;
 
         // Add option "-i" for test input file.
         cmd_options.add(
@@ -145,6 +891,13 @@ main(int argc, char** argv)
             [&ebpf_file_extension_override](auto iter) { ebpf_file_extension_override = *iter; },
             "eBPF file extension override");
 
+        // Add option "--variant" to run the objects built with a compiler flag variant.
+        cmd_options.add(
+            "--variant",
+            2,
+            [&variant](auto iter) { variant = *iter; },
+            "Run the BPF objects built with this compiler flag variant, such as mcpu_v3");
+
         // Add option "-c" to specify iteration count override.
         cmd_options.add(
             "-c",
@@ -156,6 +909,94 @@ main(int argc, char** argv)
         cmd_options.add(
             "-p", 2, [&cpu_count_override](auto iter) { cpu_count_override = std::stoi(*iter); }, "CPU count override");
 
+        // Add option "--trials" to specify the number of measured trials per test.
+        cmd_options.add(
+            "--trials",
+            2,
+            [&trials_override](auto iter) { trials_override = std::stoi(*iter); },
+            "Number of measured trials per test override");
+
+        // Add option "--warmup" to specify the number of discarded warmup runs per test.
+        cmd_options.add(
+            "--warmup",
+            2,
+            [&warmup_override](auto iter) { warmup_override = std::stoi(*iter); },
+            "Number of discarded warmup runs per test override");
+
+        // Add option "--target-duration-ms" to calibrate iteration counts to a per-run wall-clock budget.
+        cmd_options.add(
+            "--target-duration-ms",
+            2,
+            [&target_duration_ms_override](auto iter) { target_duration_ms_override = std::stoi(*iter); },
+            "Calibrate iteration counts so each run takes about this many milliseconds");
+
+        // Add option "--min-overlap-percent" to reject trials where the CPUs did not run concurrently.
+        cmd_options.add(
+            "--min-overlap-percent",
+            2,
+            [&min_overlap_percent_override](auto iter) { min_overlap_percent_override = std::stod(*iter); },
+            "Fail a test if its CPUs ran concurrently for less than this percentage of a trial");
+
+        // Add option "--duration-seconds" to run each trial for a fixed time instead of a fixed iteration count.
+        cmd_options.add(
+            "--duration-seconds",
+            2,
+            [&duration_seconds_override](auto iter) { duration_seconds_override = std::stod(*iter); },
+            "Run each trial for this many seconds instead of a fixed iteration count");
+
+        // Add option "--histogram" to record per-slice latency histograms for every test.
+        cmd_options.add(
+            "--histogram",
+            1,
+            [&histogram_override](auto iter) { histogram_override = {true}; },
+            "Record a histogram of per-slice durations for every test");
+
+        // Add option "--perf-counters" to record hardware performance counters for every test.
+        cmd_options.add(
+            "--perf-counters",
+            1,
+            [&perf_counters_override](auto iter) { perf_counters_override = {true}; },
+            "Record hardware performance counters for every test");
+
+        // Add option "--scaling-sweep" to run every test that supports it as a scaling sweep.
+        cmd_options.add(
+            "--scaling-sweep",
+            1,
+            [&scaling_sweep_override](auto iter) { scaling_sweep_override = {true}; },
+            "Run each test with \"all\" or \"remaining\" CPU assignments on 1, 2, 4, ... of those CPUs");
+
+        // Add option "--format" to select the output format.
+        cmd_options.add(
+            "--format",
+            2,
+            [&output_format](auto iter) { output_format = *iter; },
+            "Output format: csv (default), jsonl or openmetrics");
+
+        // Add option "-o" to write the results to a file instead of stdout.
+        cmd_options.add(
+            "-o", 2, [&output_file](auto iter) { output_file = *iter; }, "Output file (default stdout)");
+
+        // Add option "--compare" to check the results for regressions against those of an earlier run.
+        cmd_options.add(
+            "--compare",
+            2,
+            [&previous_results_file](auto iter) { previous_results_file = *iter; },
+            "Compare the results with those of an earlier run written with --format jsonl, failing on slowdowns");
+
+        // Add option "--regression-threshold" to set the smallest slowdown that counts as a regression.
+        cmd_options.add(
+            "--regression-threshold",
+            2,
+            [&regression_threshold_percent](auto iter) { regression_threshold_percent = std::stod(*iter); },
+            "Smallest significant slowdown of the median duration, in percent, that fails --compare (default 5)");
+
+        // Add option "--preflight" to check that the CPUs of the tests are set up for measurements with little noise.
+        cmd_options.add(
+            "--preflight",
+            2,
+            [&preflight](auto iter) { preflight = *iter; },
+            "Check that the CPUs of the tests are isolated and use the performance governor, and warn or fail if not");
+
         // Add option to ignore return code from BPF programs.
         cmd_options.add(
             "-r",
@@ -163,6 +1004,34 @@ main(int argc, char** argv)
             [&ignore_return_code](auto iter) { ignore_return_code = {true}; },
             "Ignore return code from BPF programs");
 
+        // Add option to stop after validating the config file and loading the BPF objects.
+        cmd_options.add(
+            "--validate-only",
+            1,
+            [&validate_only](auto iter) { validate_only = true; },
+            "Validate the tests and load the BPF objects without running any tests");
+
+        // Add option to reuse programs and maps pinned in bpffs by earlier runs instead of loading them again.
+        cmd_options.add(
+            "--pin-cache",
+            1,
+            [&use_pin_cache](auto iter) { use_pin_cache = true; },
+            "Reuse BPF objects pinned by earlier runs, pinning newly loaded objects for later runs");
+
+        // Add option to change the directory of the pinned-object cache.
+        cmd_options.add(
+            "--pin-cache-dir",
+            2,
+            [&pin_cache_directory](auto iter) { pin_cache_directory = *iter; },
+            "bpffs directory of the pinned-object cache (default " DEFAULT_PIN_CACHE_DIRECTORY ")");
+
+        // Add option to remove everything from the pinned-object cache.
+        cmd_options.add(
+            "--purge-pin-cache",
+            1,
+            [&purge_pin_cache](auto iter) { purge_pin_cache = true; },
+            "Remove all objects from the pinned-object cache and exit");
+
         // Add option to run a command before each test.
         cmd_options.add(
             "--pre",
@@ -180,24 +1049,96 @@ main(int argc, char** argv)
         // Parse command line options.
         cmd_options.parse(argc, argv);
 
+        if (purge_pin_cache) {
+            pin_cache(pin_cache_directory).purge();
+            return 0;
+        }
+
+        if (use_pin_cache) {
+            cache.emplace(pin_cache_directory);
+        }
+
         if (test_file.empty()) {
             throw std::runtime_error("Test input file is required");
         }
 
+        if (preflight.has_value() && preflight.value() != "warn" && preflight.value() != "fail") {
+            throw std::runtime_error("Unknown preflight mode " + preflight.value() + ", expected warn or fail");
+        }
+
         YAML::Node config = YAML::LoadFile(test_file);
         auto tests = config["tests"];
-        std::map<std::string, bpf_object_info> bpf_objects;
 
         // Query libbpf for cpu count if not specified on command line.
         int cpu_count = cpu_count_override.value_or(libbpf_num_possible_cpus());
 
+        // Write the results to the output file if one is given, or to stdout.
+        std::ofstream output_stream;
+        if (output_file.has_value()) {
+            output_stream.open(output_file.value());
+            if (!output_stream) {
+                throw std::runtime_error("Failed to open output file " + output_file.value());
+            }
+        }
+        auto sink = create_result_sink(
+            output_format, output_file.has_value() ? output_stream : std::cout, static_cast<size_t>(cpu_count));
+
+        // Read the previous results to compare with before running anything, so that a bad file fails early.
+        std::optional<regression_check> regressions;
+        if (previous_results_file.has_value()) {
+            regressions.emplace(
+                previous_results_file.value(), regression_threshold_percent, REGRESSION_SIGNIFICANCE);
+        }
+
         // Fail if tests is empty or not a sequence.
         if (!tests || !tests.IsSequence()) {
             throw std::runtime_error("Invalid config file - tests must be a sequence");
         }
 
-        // Run each test.
+        // Check if node baseline exists.
+        std::optional<baseline_configuration> baseline;
+        auto baseline_node = config["baseline"];
+        if (baseline_node) {
+            if (!baseline_node["elf_file"].IsDefined()) {
+                throw std::runtime_error("Field baseline.elf_file is required");
+            }
+            if (!baseline_node["program"].IsDefined()) {
+                throw std::runtime_error("Field baseline.program is required");
+            }
+            baseline.emplace();
+            baseline->elf_file = baseline_node["elf_file"].as<std::string>();
+            baseline->program = baseline_node["program"].as<std::string>();
+            baseline->iteration_count = DEFAULT_BASELINE_ITERATION_COUNT;
+            baseline->trials = DEFAULT_BASELINE_TRIALS;
+            if (baseline_node["iteration_count"].IsDefined()) {
+                baseline->iteration_count = baseline_node["iteration_count"].as<int>();
+            }
+            if (baseline_node["trials"].IsDefined()) {
+                baseline->trials = baseline_node["trials"].as<int>();
+            }
+            if (baseline->iteration_count < 1) {
+                throw std::runtime_error("Field baseline.iteration_count must be greater than zero");
+            }
+            if (baseline->trials < 1) {
+                throw std::runtime_error("Field baseline.trials must be greater than zero");
+            }
+            if (ebpf_file_extension_override.has_value()) {
+                baseline->elf_file = baseline->elf_file.substr(0, baseline->elf_file.find_last_of('.')) +
+                                     ebpf_file_extension_override.value();
+            }
+        }
+
+        // Parse and validate every test before loading anything, so that a bad entry late in the file is reported
+        // before any time is spent benchmarking.
+        std::vector<test_configuration> test_configurations;
+        std::vector<expanded_test> expanded_tests;
         for (auto test : tests) {
+            auto expanded = expand_test_matrix(test);
+            expanded_tests.insert(expanded_tests.end(), expanded.begin(), expanded.end());
+        }
+        for (auto& expanded : expanded_tests) {
+            auto& test = expanded.test;
+
             // Check for required fields.
             if (!test["name"].IsDefined()) {
                 throw std::runtime_error("Field name is required");
@@ -220,15 +1161,181 @@ main(int argc, char** argv)
             }
 
             // Per test fields.
-            std::string name = test["name"].as<std::string>();
-            std::string elf_file = test["elf_file"].as<std::string>();
-            int iteration_count = test["iteration_count"].as<int>();
-            std::optional<std::string> program_type;
-            bpf_prog_type actual_prog_type = DEFAULT_PROG_TYPE;
-            int batch_size;
-            bool pass_data = DEFAULT_PASS_DATA;
-            bool pass_context = DEFAULT_PASS_CONTEXT;
-            uint32_t expected_result = 0;
+            test_configuration configuration;
+            configuration.name = test["name"].as<std::string>();
+            configuration.group = expanded.group;
+            configuration.parameters = expanded.parameters;
+            configuration.elf_file = test["elf_file"].as<std::string>();
+
+            configuration.iteration_count = test["iteration_count"].as<int>();
+            configuration.batch_size = DEFAULT_BATCH_SIZE;
+            configuration.pass_data = DEFAULT_PASS_DATA;
+            configuration.pass_context = DEFAULT_PASS_CONTEXT;
+            configuration.expected_result = 0;
+            configuration.trials = 1;
+            configuration.warmup = 0;
+            configuration.slice_iteration_count = DEFAULT_SLICE_ITERATION_COUNT;
+            configuration.histogram = false;
+            configuration.perf_counters = false;
+            configuration.scaling_sweep = false;
+            configuration.ring_buffer_consumer_busy_poll = false;
+            configuration.map_state_preparation_iteration_count = 0;
+            configuration.program_cpu_assignment = test["program_cpu_assignment"];
+
+            // Check if trials is defined and use it.
+            if (test["trials"].IsDefined()) {
+                configuration.trials = test["trials"].as<int>();
+            }
+
+            // Check if warmup is defined and use it.
+            if (test["warmup"].IsDefined()) {
+                configuration.warmup = test["warmup"].as<int>();
+            }
+
+            // Override trials and warmup if specified on command line.
+            configuration.trials = trials_override.value_or(configuration.trials);
+            configuration.warmup = warmup_override.value_or(configuration.warmup);
+
+            if (configuration.trials < 1) {
+                throw std::runtime_error("Field trials must be greater than zero");
+            }
+
+            if (configuration.warmup < 0) {
+                throw std::runtime_error("Field warmup must not be negative");
+            }
+
+            // Check if target_duration_ms is defined and use it.
+            if (test["target_duration_ms"].IsDefined()) {
+                configuration.target_duration_ms = test["target_duration_ms"].as<int>();
+            }
+
+            // Override target_duration_ms if specified on command line.
+            if (target_duration_ms_override.has_value()) {
+                configuration.target_duration_ms = target_duration_ms_override;
+            }
+
+            if (configuration.target_duration_ms.has_value() && configuration.target_duration_ms.value() < 1) {
+                throw std::runtime_error("Field target_duration_ms must be greater than zero");
+            }
+
+            // Check if min_overlap_percent is defined and use it.
+            if (test["min_overlap_percent"].IsDefined()) {
+                configuration.min_overlap_percent = test["min_overlap_percent"].as<double>();
+            }
+
+            // Override min_overlap_percent if specified on command line.
+            if (min_overlap_percent_override.has_value()) {
+                configuration.min_overlap_percent = min_overlap_percent_override;
+            }
+
+            if (configuration.min_overlap_percent.has_value() &&
+                (configuration.min_overlap_percent.value() < 0 || configuration.min_overlap_percent.value() > 100)) {
+                throw std::runtime_error("Field min_overlap_percent must be between 0 and 100");
+            }
+
+            // Check if duration_seconds is defined and use it.
+            if (test["duration_seconds"].IsDefined()) {
+                configuration.duration_seconds = test["duration_seconds"].as<double>();
+            }
+
+            // Override duration_seconds if specified on command line.
+            if (duration_seconds_override.has_value()) {
+                configuration.duration_seconds = duration_seconds_override;
+            }
+
+            if (configuration.duration_seconds.has_value() && configuration.duration_seconds.value() <= 0) {
+                throw std::runtime_error("Field duration_seconds must be greater than zero");
+            }
+
+            // Check if slice_iteration_count is defined and use it.
+            if (test["slice_iteration_count"].IsDefined()) {
+                configuration.slice_iteration_count = test["slice_iteration_count"].as<int>();
+            }
+
+            if (configuration.slice_iteration_count < 1) {
+                throw std::runtime_error("Field slice_iteration_count must be greater than zero");
+            }
+
+            // Check if histogram is defined and use it.
+            if (test["histogram"].IsDefined()) {
+                configuration.histogram = test["histogram"].as<bool>();
+            }
+
+            // Override histogram if specified on command line.
+            configuration.histogram = histogram_override.value_or(configuration.histogram);
+
+            // Check if perf_counters is defined and use it.
+            if (test["perf_counters"].IsDefined()) {
+                configuration.perf_counters = test["perf_counters"].as<bool>();
+            }
+
+            // Override perf_counters if specified on command line.
+            configuration.perf_counters = perf_counters_override.value_or(configuration.perf_counters);
+
+            // Check if scaling_sweep is defined and use it.
+            if (test["scaling_sweep"].IsDefined()) {
+                configuration.scaling_sweep = test["scaling_sweep"].as<bool>();
+            }
+
+            // Check if node map_state_preparation exits.
+            auto map_state_preparation = test["map_state_preparation"];
+            if (map_state_preparation) {
+                if (!map_state_preparation["program"].IsDefined()) {
+                    throw std::runtime_error("Field map_state_preparation.program is required");
+                }
+
+                if (!map_state_preparation["iteration_count"].IsDefined()) {
+                    throw std::runtime_error("Field map_state_preparation.iteration_count is required");
+                }
+
+                configuration.map_state_preparation_program = map_state_preparation["program"].as<std::string>();
+                configuration.map_state_preparation_iteration_count =
+                    map_state_preparation["iteration_count"].as<int>();
+            }
+
+            // Check if node map_population exists.
+            auto map_population_node = test["map_population"];
+            if (map_population_node) {
+                if (!map_population_node.IsSequence()) {
+                    throw std::runtime_error("Field map_population must be a sequence");
+                }
+
+                for (auto population : map_population_node) {
+                    configuration.map_populations.push_back(parse_map_population(population));
+                }
+            }
+
+            // Check if parameters are defined and use them. They are reported alongside the matrix parameters
+            // unless a matrix variable of the same name already reports them.
+            if (test["parameters"].IsDefined()) {
+                configuration.global_parameters = parse_rodata_parameters(test["parameters"]);
+                for (auto& [name, value] : configuration.global_parameters) {
+                    auto& reported = configuration.parameters;
+                    if (std::none_of(reported.begin(), reported.end(), [&](auto& p) { return p.first == name; })) {
+                        reported.push_back({name, std::to_string(value)});
+                    }
+                }
+            }
+
+            // Check if operation_map is defined and use it.
+            if (test["operation_map"].IsDefined()) {
+                configuration.operation_map = test["operation_map"].as<std::string>();
+            }
+
+            // Check if node ring_buffer_consumer exists.
+            auto ring_buffer_consumer_node = test["ring_buffer_consumer"];
+            if (ring_buffer_consumer_node) {
+                if (!ring_buffer_consumer_node["map"].IsDefined()) {
+                    throw std::runtime_error("Field ring_buffer_consumer.map is required");
+                }
+                configuration.ring_buffer_consumer_map = ring_buffer_consumer_node["map"].as<std::string>();
+                if (ring_buffer_consumer_node["busy_poll"].IsDefined()) {
+                    configuration.ring_buffer_consumer_busy_poll = ring_buffer_consumer_node["busy_poll"].as<bool>();
+                }
+                if (ring_buffer_consumer_node["cpu"].IsDefined()) {
+                    configuration.ring_buffer_consumer_cpu = ring_buffer_consumer_node["cpu"].as<size_t>();
+                }
+            }
 
             // Check if value "platform" is defined and matches the current platform.
             if (test["platform"].IsDefined()) {
@@ -241,182 +1348,181 @@ main(int argc, char** argv)
 
             // Check if value "program_type" is defined and use it.
             if (test["program_type"].IsDefined()) {
-                program_type = test["program_type"].as<std::string>();
+                configuration.program_type = test["program_type"].as<std::string>();
             }
 
             // Check if value "batch_size" is defined and use it.
             if (test["batch_size"].IsDefined()) {
-                batch_size = test["batch_size"].as<int>();
-            } else {
-                batch_size = DEFAULT_BATCH_SIZE;
+                configuration.batch_size = test["batch_size"].as<int>();
             }
 
             // Check if pass_data is defined and use it.
             if (test["pass_data"].IsDefined()) {
-                pass_data = test["pass_data"].as<bool>();
+                configuration.pass_data = test["pass_data"].as<bool>();
             }
 
             // Check if pass_context is defined and use it.
             if (test["pass_context"].IsDefined()) {
-                pass_context = test["pass_context"].as<bool>();
+                configuration.pass_context = test["pass_context"].as<bool>();
             }
 
             // Check if expected_result is defined and use it.
             if (test["expected_result"].IsDefined()) {
-                expected_result = test["expected_result"].as<uint32_t>();
+                configuration.expected_result = test["expected_result"].as<uint32_t>();
             }
 
             // Override batch size if specified on command line.
             if (batch_size_override.has_value()) {
-                batch_size = batch_size_override.value();
+                configuration.batch_size = batch_size_override.value();
             }
 
             // Skip if test name is specified and doesn't match, with test name being a regex.
-            if (test_name && !std::regex_match(name, std::regex(*test_name))) {
+            if (test_name && !std::regex_match(configuration.name, std::regex(*test_name))) {
                 continue;
             }
 
+            // If a variant is specified, use its objects, named <object>_<variant>, and tell its results apart from
+            // those of the default build while keeping them in the same group.
+            if (variant.has_value()) {
+                size_t extension = std::min(configuration.elf_file.find_last_of('.'), configuration.elf_file.size());
+                configuration.elf_file = configuration.elf_file.substr(0, extension) + "_" + variant.value() +
+                                         configuration.elf_file.substr(extension);
+                configuration.name += " (" + variant.value() + ")";
+                configuration.parameters.push_back({"variant", variant.value()});
+            }
+
             // If eBPF file extension override is specified, use it.
             // Windows uses .sys instead of .o for eBPF files that are compiled into a driver.
             if (ebpf_file_extension_override.has_value()) {
-                elf_file = elf_file.substr(0, elf_file.find_last_of('.')) + ebpf_file_extension_override.value();
+                configuration.elf_file =
+                    configuration.elf_file.substr(0, configuration.elf_file.find_last_of('.')) +
+                    ebpf_file_extension_override.value();
             }
 
-            if (bpf_objects.find(elf_file) == bpf_objects.end()) {
-                bpf_object_ptr obj;
-
-                obj.reset(bpf_object__open(elf_file.c_str()));
-                if (!obj) {
-                    throw std::runtime_error("Failed to open BPF object " + elf_file + ": " + strerror(errno) + "/" + std::to_string(errno));
-                }
-
-                bpf_program* program;
-                bpf_object__for_each_program(program, obj.get())
-                {
-                    bpf_prog_type prog_type;
-                    bpf_attach_type attach_type;
-                    if (program_type.has_value()) {
-                        // If program_type is specified, use it.
-                        if (libbpf_prog_type_by_name(program_type->c_str(), &prog_type, &attach_type) < 0) {
-                            throw std::runtime_error("Failed to get program type " + *program_type);
-                        }
-                    } else {
-                        // If program_type is not specified, use DEFAULT_PROG_TYPE.
-                        prog_type = DEFAULT_PROG_TYPE;
-                        attach_type = DEFAULT_ATTACH_TYPE;
-                    }
-                    actual_prog_type = prog_type;
-                    (void)bpf_program__set_type(program, prog_type);
-                }
-
-                if (bpf_object__load(obj.get()) < 0) {
-                    throw std::runtime_error("Failed to load BPF object " + elf_file + ": " + strerror(errno) + "/" + std::to_string(errno));
-                }
-
-                // Insert into bpf_objects with program type
-                bpf_object_info obj_info;
-                obj_info.obj = std::move(obj);
-                obj_info.prog_type = actual_prog_type;
-                bpf_objects.insert({elf_file, std::move(obj_info)});
-            } else {
-                // Reuse existing object but validate that the requested program type matches
-                bpf_prog_type expected_prog_type;
-                if (program_type.has_value()) {
-                    bpf_attach_type attach_type;
-                    if (libbpf_prog_type_by_name(program_type->c_str(), &expected_prog_type, &attach_type) < 0) {
-                        throw std::runtime_error("Failed to get program type " + *program_type);
-                    }
-                } else {
-                    expected_prog_type = DEFAULT_PROG_TYPE;
-                }
+            configuration.prog_type = resolve_program_type(configuration.program_type);
 
-                bpf_prog_type existing_prog_type = bpf_objects[elf_file].prog_type;
-                if (existing_prog_type != expected_prog_type) {
-                    throw std::runtime_error("Program type mismatch for BPF object " + elf_file + 
-                        ": expected type does not match the type used when object was first loaded");
-                }
+            test_configurations.push_back(std::move(configuration));
+        }
 
-                actual_prog_type = existing_prog_type;
+        // Collect the BPF objects used by the selected tests. Each object is loaded once for each set of parameters and
+        // shared by every test that uses it, so all of those tests must agree on the program type.
+        std::vector<bpf_object_request> objects_to_load;
+        std::map<std::string, bpf_prog_type> object_prog_types;
+        for (auto& test : test_configurations) {
+            std::string key = object_key(test.elf_file, test.global_parameters);
+            auto existing = object_prog_types.find(key);
+            if (existing == object_prog_types.end()) {
+                object_prog_types[key] = test.prog_type;
+                objects_to_load.push_back({test.elf_file, test.prog_type, test.global_parameters});
+            } else if (existing->second != test.prog_type) {
+                throw std::runtime_error(
+                    "Program type mismatch for BPF object " + test.elf_file +
+                    ": expected type does not match the type used when object was first loaded");
             }
+        }
 
-            // Vector of CPU -> program fd.
-            std::vector<std::optional<int>> cpu_program_assignments(cpu_count);
-
-            bpf_object_ptr& obj = bpf_objects[elf_file].obj;
+        // Load all objects up front, concurrently, before any timed test starts.
+        std::map<std::string, bpf_object_info> bpf_objects = load_bpf_objects(objects_to_load, cache);
 
-            // Check if node map_state_preparation exits.
-            auto map_state_preparation = test["map_state_preparation"];
-            if (map_state_preparation) {
-                if (!map_state_preparation["program"].IsDefined()) {
-                    throw std::runtime_error("Field map_state_preparation.program is required");
-                }
-
-                if (!map_state_preparation["iteration_count"].IsDefined()) {
-                    throw std::runtime_error("Field map_state_preparation.iteration_count is required");
+        // Load the baseline program once for each program type of the tests, so that it runs as their programs do.
+        std::map<bpf_prog_type, bpf_object_info> baseline_objects;
+        std::map<bpf_prog_type, int> baseline_program_fds;
+        if (baseline.has_value()) {
+            for (auto& [elf_file, prog_type, global_parameters] : objects_to_load) {
+                if (baseline_objects.find(prog_type) != baseline_objects.end()) {
+                    continue;
                 }
-
-                std::string prep_program_name = map_state_preparation["program"].as<std::string>();
-                int prep_program_iterations = map_state_preparation["iteration_count"].as<int>();
-                auto map_state_preparation_program =
-                    bpf_object__find_program_by_name(obj.get(), prep_program_name.c_str());
-                if (!map_state_preparation_program) {
-                    throw std::runtime_error("Failed to find map_state_preparation program " + prep_program_name);
+                baseline_objects[prog_type] = load_bpf_object(baseline->elf_file, prog_type, cache);
+                auto program_fd = find_program_fd(baseline_objects[prog_type], baseline->program);
+                if (!program_fd.has_value()) {
+                    throw std::runtime_error("Failed to find baseline program " + baseline->program);
                 }
+                baseline_program_fds[prog_type] = program_fd.value();
+            }
+        }
 
-                // Run map_state_preparation program via bpf_prog_test_run_opts.
-                std::vector<uint8_t> data_in(1024);
-                std::vector<uint8_t> data_out(1024);
+        // Save the freshly loaded map contents so that each test starts from them, whatever ran before it.
+        for (auto& [elf_file, obj_info] : bpf_objects) {
+            obj_info.initial_state = map_snapshot(object_maps(obj_info));
+        }
 
-                bpf_test_run_opts opts;
-                memset(&opts, 0, sizeof(opts));
-                opts.sz = sizeof(opts);
-                opts.repeat = prep_program_iterations;
-                if (pass_data) {
-                    opts.data_in = data_in.data();
-                    opts.data_out = data_out.data();
-                    opts.data_size_in = static_cast<uint32_t>(data_in.size());
-                    opts.data_size_out = static_cast<uint32_t>(data_out.size());
-                }
-                if (pass_context) {
-                    opts.ctx_in = data_in.data();
-                    opts.ctx_out = data_out.data();
-                    opts.ctx_size_in = static_cast<uint32_t>(data_in.size());
-                    opts.ctx_size_out = static_cast<uint32_t>(data_out.size());
+        // Resolve the programs named by each test against its loaded object, and the CPUs it assigns them to
+        // against the topology of the host.
+        cpu_topology topology(static_cast<size_t>(cpu_count));
+        for (auto& test : test_configurations) {
+            bpf_object_info& obj_info = bpf_objects[object_key(test.elf_file, test.global_parameters)];
+            test.object = &obj_info;
+
+            for (auto& population : test.map_populations) {
+                auto map_fd = find_map_fd(obj_info, population.map_name);
+                if (!map_fd.has_value()) {
+                    throw std::runtime_error("Failed to find map_population map " + population.map_name);
                 }
-#if defined(HAS_BPF_TEST_RUN_OPTS_FLAGS) && defined(__linux__)
-                // Set BPF_F_TEST_XDP_LIVE_FRAMES flag for XDP programs on Linux
-                if (actual_prog_type == BPF_PROG_TYPE_XDP) {
-                    opts.flags |= BPF_F_TEST_XDP_LIVE_FRAMES;
+                test.map_population_fds.push_back(map_fd.value());
+            }
+
+            if (test.map_state_preparation_program.has_value()) {
+                test.map_state_preparation_program_fd =
+                    find_program_fd(obj_info, test.map_state_preparation_program.value());
+                if (!test.map_state_preparation_program_fd.has_value()) {
+                    throw std::runtime_error(
+                        "Failed to find map_state_preparation program " + *test.map_state_preparation_program);
                 }
-#endif
+            }
 
-                if (bpf_prog_test_run_opts(bpf_program__fd(map_state_preparation_program), &opts)) {
-                    throw std::runtime_error("Failed to run map_state_preparation program " + prep_program_name);
+            test.operation_map_object = nullptr;
+            if (test.operation_map.has_value()) {
+                test.operation_map_object =
+                    bpf_object__find_map_by_name(obj_info.obj.get(), test.operation_map.value().c_str());
+                test.operation_map_fd = find_map_fd(obj_info, test.operation_map.value());
+                if (!test.operation_map_object || !test.operation_map_fd.has_value()) {
+                    throw std::runtime_error("Failed to find operation_map map " + test.operation_map.value());
                 }
+            }
 
-                if (opts.retval != expected_result) {
-                    std::string message = "map_state_preparation program " + prep_program_name + " returned unexpected value " +
-                                          std::to_string(opts.retval) + " expected " + std::to_string(expected_result);
-                    if (ignore_return_code.value_or(false)) {
-                        std::cout << message << std::endl;
-                    } else {
-                        throw std::runtime_error(message);
-                    }
+            test.ring_buffer_consumer_perf_event_array = false;
+            if (test.ring_buffer_consumer_map.has_value()) {
+                auto map =
+                    bpf_object__find_map_by_name(obj_info.obj.get(), test.ring_buffer_consumer_map.value().c_str());
+                test.ring_buffer_consumer_map_fd = find_map_fd(obj_info, test.ring_buffer_consumer_map.value());
+                if (!map || !test.ring_buffer_consumer_map_fd.has_value()) {
+                    throw std::runtime_error(
+                        "Failed to find ring_buffer_consumer map " + test.ring_buffer_consumer_map.value());
                 }
+                test.ring_buffer_consumer_perf_event_array = bpf_map__type(map) == BPF_MAP_TYPE_PERF_EVENT_ARRAY;
             }
 
-            auto program_cpu_assignment = test["program_cpu_assignment"];
-            for (auto assignment : program_cpu_assignment) {
+            test.cpu_program_assignments.resize(cpu_count);
+            auto& cpu_program_assignments = test.cpu_program_assignments;
+            // Whether each CPU's program was assigned with "all" or "remaining".
+            std::vector<bool> swept(cpu_count);
+            for (auto assignment : test.program_cpu_assignment) {
                 // Each node is a program name and a cpu number or a list of cpu numbers.
                 // First check if program exists and get program fd.
 
                 auto program_name = assignment.first.as<std::string>();
-                auto program = bpf_object__find_program_by_name(obj.get(), program_name.c_str());
-                if (!program) {
+                std::optional<int> program;
+                if (test.operation_map.has_value()) {
+                    // Map operations take the place of program fds.
+                    auto operation = map_operation_by_name(program_name);
+                    if (!operation.has_value()) {
+                        throw std::runtime_error("Unknown map operation " + program_name);
+                    }
+                    if (is_batch_map_operation(operation.value()) && test.batch_size < 1) {
+                        throw std::runtime_error(
+                            "Test " + test.name + " runs map operation " + program_name +
+                            " which requires batch_size to be greater than zero");
+                    }
+                    program = static_cast<int>(operation.value());
+                } else {
+                    program = find_program_fd(obj_info, program_name);
+                }
+                if (!program.has_value()) {
                     throw std::runtime_error("Failed to find program " + program_name);
                 }
 
-                int program_fd = bpf_program__fd(program);
+                int program_fd = program.value();
+                test.program_names[program_fd] = program_name;
 
                 // Check if assignment is scalar or sequence
                 if (assignment.second.IsScalar()) {
@@ -424,107 +1530,137 @@ main(int argc, char** argv)
                         // Assign program to all CPUs.
                         for (size_t i = 0; i < cpu_program_assignments.size(); i++) {
                             cpu_program_assignments[i] = {program_fd};
+                            swept[i] = true;
                         }
                     } else if (assignment.second.as<std::string>() == "remaining") {
                         // Assign program to all remaining CPUs.
                         for (size_t i = 0; i < cpu_program_assignments.size(); i++) {
                             if (!cpu_program_assignments[i].has_value()) {
                                 cpu_program_assignments[i] = {program_fd};
+                                swept[i] = true;
                             }
                         }
                     } else {
-                        int cpu = assignment.second.as<int>();
-                        if (cpu > cpu_count) {
-                            throw std::runtime_error("Invalid CPU number " + std::to_string(cpu));
+                        for (size_t cpu : topology.select(assignment.second.as<std::string>())) {
+                            cpu_program_assignments[cpu] = {program_fd};
+                            swept[cpu] = false;
                         }
-                        cpu_program_assignments[assignment.as<int>()] = {program_fd};
                     }
                 } else if (assignment.second.IsSequence()) {
                     for (auto cpu_assignment : assignment.second) {
-                        int cpu = cpu_assignment.as<int>();
-                        if (cpu > cpu_count) {
-                            throw std::runtime_error("Invalid CPU number " + std::to_string(cpu));
+                        for (size_t cpu : topology.select(cpu_assignment.as<std::string>())) {
+                            cpu_program_assignments[cpu] = {program_fd};
+                            swept[cpu] = false;
                         }
-                        cpu_program_assignments[cpu] = {program_fd};
                     }
                 } else {
                     throw std::runtime_error("Invalid program_cpu_assignment - must be string or sequence");
                 }
             }
 
-            // Run the pre-test command if specified.
-            if (pre_test_command.has_value()) {
-                std::string command = pre_test_command.value();
-                std::string command_output;
-                command = std::regex_replace(command, std::regex("%NAME%"), name);
-                command = std::regex_replace(command, std::regex("%ELF_FILE%"), elf_file);
-                command = std::regex_replace(command, std::regex("%ITERATION_COUNT%"), std::to_string(iteration_count));
-                command = std::regex_replace(command, std::regex("%CPU_COUNT%"), std::to_string(cpu_count));
-                command = std::regex_replace(command, std::regex("%BATCH_SIZE%"), std::to_string(batch_size));
-                if (run_command_and_capture_output(command, command_output) != 0) {
-                    std::cerr << "Pre-test command failed: " << command << std::endl;
-                    std::cerr << command_output << std::endl;
+            for (size_t i = 0; i < swept.size(); i++) {
+                if (swept[i]) {
+                    test.sweep_cpus.push_back(i);
                 }
             }
 
-            auto now = std::chrono::system_clock::now();
+            // A scaling sweep is only meaningful for tests that run on a variable number of CPUs. A command line
+            // override applies to those tests and leaves the others as they are.
+            if (scaling_sweep_override.value_or(false) && !test.sweep_cpus.empty()) {
+                test.scaling_sweep = true;
+            }
+            if (test.scaling_sweep && test.sweep_cpus.empty()) {
+                throw std::runtime_error(
+                    "Test " + test.name + " has scaling_sweep set but no program assigned to all or remaining CPUs");
+            }
+        }
 
-            // Run each entry point via bpf_prog_test_run_opts in a thread.
-            std::vector<std::jthread> threads;
-            std::vector<bpf_test_run_opts> opts(cpu_count);
+        if (validate_only) {
+            std::cout << "Validated " << test_configurations.size() << " tests using " << bpf_objects.size()
+                      << " BPF objects" << std::endl;
+            return 0;
+        }
 
-            for (size_t i = 0; i < cpu_program_assignments.size(); i++) {
-                if (!cpu_program_assignments[i].has_value()) {
-                    continue;
-                }
-                auto program = cpu_program_assignments[i].value();
-                auto& opt = opts[i];
-
-                threads.emplace_back([=, &opt](std::stop_token stop_token) {
-                    memset(&opt, 0, sizeof(opt));
-                    std::vector<uint8_t> data_in(1024);
-                    std::vector<uint8_t> data_out(1024);
-
-                    opt.sz = sizeof(opt);
-                    opt.repeat = iteration_count_override.value_or(iteration_count);
-                    opt.cpu = static_cast<uint32_t>(i);
-                    if (pass_data) {
-                        opt.data_in = data_in.data();
-                        opt.data_out = data_out.data();
-                        opt.data_size_in = static_cast<uint32_t>(data_in.size());
-                        opt.data_size_out = static_cast<uint32_t>(data_out.size());
+        // Per-trial baseline durations on each CPU, measured once for each program type, data, context, batch size and
+        // set of CPUs used by the tests.
+        std::map<std::tuple<bpf_prog_type, bool, bool, int, std::vector<bool>>, std::vector<std::vector<double>>>
+            baselines;
+
+        // Check the CPUs that any test runs on.
+        if (preflight.has_value()) {
+            std::vector<size_t> test_cpus;
+            for (size_t cpu = 0; cpu < static_cast<size_t>(cpu_count); cpu++) {
+                for (auto& test : test_configurations) {
+                    if (test.cpu_program_assignments[cpu].has_value()) {
+                        test_cpus.push_back(cpu);
+                        break;
                     }
-                    if (pass_context) {
-                        opt.ctx_in = data_in.data();
-                        opt.ctx_out = data_out.data();
-                        opt.ctx_size_in = static_cast<uint32_t>(data_in.size());
-                        opt.ctx_size_out = static_cast<uint32_t>(data_out.size());
-                    }
-#if defined(HAS_BPF_TEST_RUN_OPTS_BATCH_SIZE)
-                    opt.batch_size = batch_size;
-#endif
+                }
+            }
+            auto problems = preflight_problems(test_cpus);
+            for (auto& problem : problems) {
+                std::cerr << "Warning: Preflight: " << problem << std::endl;
+            }
+            if (!problems.empty() && preflight.value() == "fail") {
+                throw std::runtime_error(
+                    "Preflight found " + std::to_string(problems.size()) +
+                    (problems.size() == 1 ? " problem" : " problems"));
+            }
+        }
+
+        // Record the state of the host with every result, so that results from hosts set up differently are not
+        // mistaken for each other.
+        environment_fingerprint environment = capture_environment_fingerprint();
+
+        // Run each test.
+        for (auto& test : test_configurations) {
+            auto& name = test.name;
+
+            // Undo any changes to the maps made by earlier tests using the same object.
+            test.object->initial_state.restore();
+
+            // Write the declared elements to their maps.
+            for (size_t i = 0; i < test.map_populations.size(); i++) {
+                populate_map(test.object->obj.get(), test.map_population_fds[i], test.map_populations[i]);
+            }
+
+            // Run the map_state_preparation program via bpf_prog_test_run_opts.
+            if (test.map_state_preparation_program_fd.has_value()) {
+                std::string prep_program_name = test.map_state_preparation_program.value();
+                std::vector<uint8_t> data_in(1024);
+                std::vector<uint8_t> data_out(1024);
+
+                bpf_test_run_opts opts;
+                memset(&opts, 0, sizeof(opts));
+                opts.sz = sizeof(opts);
+                opts.repeat = test.map_state_preparation_iteration_count;
+                if (test.pass_data) {
+                    opts.data_in = data_in.data();
+                    opts.data_out = data_out.data();
+                    opts.data_size_in = static_cast<uint32_t>(data_in.size());
+                    opts.data_size_out = static_cast<uint32_t>(data_out.size());
+                }
+                if (test.pass_context) {
+                    opts.ctx_in = data_in.data();
+                    opts.ctx_out = data_out.data();
+                    opts.ctx_size_in = static_cast<uint32_t>(data_in.size());
+                    opts.ctx_size_out = static_cast<uint32_t>(data_out.size());
+                }
 #if defined(HAS_BPF_TEST_RUN_OPTS_FLAGS) && defined(__linux__)
-                    // Set BPF_F_TEST_XDP_LIVE_FRAMES flag for XDP programs on Linux
-                    if (actual_prog_type == BPF_PROG_TYPE_XDP) {
-                        opt.flags |= BPF_F_TEST_XDP_LIVE_FRAMES;
-                    }
+                // Set BPF_F_TEST_XDP_LIVE_FRAMES flag for XDP programs on Linux
+                if (test.prog_type == BPF_PROG_TYPE_XDP) {
+                    opts.flags |= BPF_F_TEST_XDP_LIVE_FRAMES;
+                }
 #endif
 
-                    int result = bpf_prog_test_run_opts(program, &opt);
-                    if (result < 0) {
-                        opt.retval = result;
-                    }
-                });
-            }
-            for (auto& thread : threads) {
-                thread.join();
-            }
+                if (bpf_prog_test_run_opts(test.map_state_preparation_program_fd.value(), &opts)) {
+                    throw std::runtime_error("Failed to run map_state_preparation program " + prep_program_name);
+                }
 
-            // Check if any program returned unexpected result.
-            for (auto& opt : opts) {
-                if (opt.retval != expected_result) {
-                    std::string message =
-                        "Program returned unexpected result " + std::to_string(opt.retval) + " in test " + name + " expected " + std::to_string(expected_result);
+                if (opts.retval != test.expected_result) {
+                    std::string message = "map_state_preparation program " + prep_program_name +
+                                          " returned unexpected value " + std::to_string(opts.retval) +
+                                          " expected " + std::to_string(test.expected_result);
                     if (ignore_return_code.value_or(false)) {
                         std::cout << message << std::endl;
                     } else {
@@ -533,64 +1669,350 @@ main(int argc, char** argv)
                 }
             }
 
-            // Run the post-test command if specified.
-            if (post_test_command.has_value()) {
-                std::string command = post_test_command.value();
-                std::string command_output;
-                command = std::regex_replace(command, std::regex("%NAME%"), name);
-                command = std::regex_replace(command, std::regex("%ELF_FILE%"), elf_file);
-                command = std::regex_replace(command, std::regex("%ITERATION_COUNT%"), std::to_string(iteration_count));
-                command = std::regex_replace(command, std::regex("%CPU_COUNT%"), std::to_string(cpu_count));
-                command = std::regex_replace(command, std::regex("%BATCH_SIZE%"), std::to_string(batch_size));
+            // Save the prepared map contents so that every run of the test starts from them.
+            map_snapshot prepared_state(object_maps(*test.object));
+
+            test_run_parameters parameters;
+            parameters.iteration_count = iteration_count_override.value_or(test.iteration_count);
+            parameters.batch_size = test.batch_size;
+            parameters.pass_data = test.pass_data;
+            parameters.pass_context = test.pass_context;
+            parameters.prog_type = test.prog_type;
+            parameters.slice_iteration_count = test.slice_iteration_count;
+            parameters.record_histogram = test.histogram;
+            parameters.record_perf_counters = test.perf_counters;
+            if (test.operation_map_fd.has_value()) {
+                parameters.map_operation = std::make_shared<const map_operation_target>(
+                    test.operation_map_object, test.operation_map_fd.value(), test.batch_size);
+            }
+            if (test.duration_seconds.has_value()) {
+                parameters.run_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::duration<double>(test.duration_seconds.value()));
+            }
 
-                if (run_command_and_capture_output(command, command_output) != 0) {
-                    std::cerr << "Post-test command failed: " << command << std::endl;
-                    std::cerr << command_output << std::endl;
+            // Run the test once with its CPU assignments or, for a scaling sweep, once per sweep point, with the
+            // throughput of the first point (a single swept CPU) as the baseline for the scaling efficiency.
+            std::vector<std::optional<size_t>> sweep_points = {std::nullopt};
+            if (test.scaling_sweep) {
+                sweep_points.clear();
+                for (size_t point : scaling_sweep_points(test.sweep_cpus.size())) {
+                    sweep_points.push_back(point);
                 }
             }
+            double single_cpu_operations_per_second = 0;
+
+            // Read the ring buffer while the programs run, so that its producers are measured at their sustained rate
+            // instead of on the failure path of a full buffer.
+            std::optional<ring_buffer_consumer> consumer;
+            if (test.ring_buffer_consumer_map_fd.has_value()) {
+                consumer.emplace(
+                    test.ring_buffer_consumer_map_fd.value(),
+                    test.ring_buffer_consumer_perf_event_array,
+                    test.ring_buffer_consumer_busy_poll,
+                    test.ring_buffer_consumer_cpu);
+            }
+            for (auto& sweep_point : sweep_points) {
+                auto cpu_program_assignments = sweep_point.has_value()
+                                                   ? sweep_cpu_program_assignments(test, sweep_point.value())
+                                                   : test.cpu_program_assignments;
+                parameters.iteration_count = iteration_count_override.value_or(test.iteration_count);
+
+                // Measure the baseline the first time its settings and CPUs are used, so that each CPU's duration is
+                // corrected by the baseline measured on that CPU alongside the same other CPUs. Map operations don't
+                // run a program, so they have no baseline.
+                const std::vector<std::vector<double>>* cpu_baseline_durations = nullptr;
+                if (baseline.has_value() && !parameters.map_operation) {
+                    std::vector<bool> cpus(cpu_program_assignments.size());
+                    for (size_t i = 0; i < cpu_program_assignments.size(); i++) {
+                        cpus[i] = cpu_program_assignments[i].has_value();
+                    }
+                    auto key = std::make_tuple(
+                        test.prog_type, test.pass_data, test.pass_context, test.batch_size, std::move(cpus));
+                    auto existing = baselines.find(key);
+                    if (existing == baselines.end()) {
+                        test_run_parameters baseline_parameters = parameters;
+                        baseline_parameters.iteration_count = baseline->iteration_count;
+                        auto durations = measure_baseline(
+                            baseline_program_fds[test.prog_type],
+                            cpu_program_assignments,
+                            baseline_parameters,
+                            baseline->trials);
+                        existing = baselines.emplace(std::move(key), std::move(durations)).first;
+                    }
+                    cpu_baseline_durations = &existing->second;
+                }
 
-            // Print a CSV header if not already printed.
-            if (!csv_header_printed) {
-                std::cout << "Timestamp,";
-                std::cout << "Test,";
-                std::cout << "Average Duration (ns),";
-                for (size_t i = 0; i < opts.size(); i++) {
-                    if (!cpu_program_assignments[i].has_value()) {
+                // Throw if the run on a CPU failed, or its program returned an unexpected result. With a ring buffer
+                // consumer, records that could not be written to a full buffer are reported in the drop rate instead.
+                auto check_result = [&](size_t cpu, const cpu_run_result& result) {
+                    auto& program_name = test.program_names[cpu_program_assignments[cpu].value()];
+                    if (result.error < 0) {
+                        throw std::runtime_error(
+                            std::string(parameters.map_operation ? "Map operation " : "Program ") + program_name +
+                            " failed on CPU " + std::to_string(cpu) + " in test " + name + ": " +
+                            strerror(-result.error));
+                    }
+                    auto retval = result.opts.retval;
+                    bool dropped = consumer.has_value() && retval == RING_BUFFER_FULL_RESULT;
+                    if (!parameters.map_operation && retval != test.expected_result && !dropped) {
+                        std::string message = "Program returned unexpected result " + std::to_string(retval) +
+                                              " on CPU " + std::to_string(cpu) + " in test " + name + " expected " +
+                                              std::to_string(test.expected_result);
+                        if (ignore_return_code.value_or(false)) {
+                            std::cout << message << std::endl;
+                        } else {
+                            throw std::runtime_error(message);
+                        }
+                    }
+                };
+
+                // Calibrate the iteration count unless one was given explicitly on the command line.
+                if (test.target_duration_ms.has_value() && !iteration_count_override.has_value() &&
+                    !parameters.run_duration.has_value()) {
+                    parameters.iteration_count = calibrate_iteration_count(
+                        cpu_program_assignments,
+                        parameters,
+                        std::chrono::milliseconds(test.target_duration_ms.value()),
+                        check_result);
+                }
+
+                // Run the pre-test command if specified.
+                if (pre_test_command.has_value()) {
+                    std::string command = pre_test_command.value();
+                    std::string command_output;
+                    command = std::regex_replace(command, std::regex("%NAME%"), name);
+                    command = std::regex_replace(command, std::regex("%ELF_FILE%"), test.elf_file);
+                    command = std::regex_replace(
+                        command, std::regex("%ITERATION_COUNT%"), std::to_string(parameters.iteration_count));
+                    command = std::regex_replace(command, std::regex("%CPU_COUNT%"), std::to_string(cpu_count));
+                    command = std::regex_replace(command, std::regex("%BATCH_SIZE%"), std::to_string(test.batch_size));
+                    if (run_command_and_capture_output(command, command_output) != 0) {
+                        std::cerr << "Pre-test command failed: " << command << std::endl;
+                        std::cerr << command_output << std::endl;
+                    }
+                }
+
+                auto now = std::chrono::system_clock::now();
+
+                // Per-CPU durations and per-trial averages of the measured trials.
+                std::vector<std::vector<double>> cpu_durations(cpu_count);
+                std::vector<double> trial_average_durations;
+                std::vector<double> trial_overlap_percents;
+                std::vector<std::vector<double>> cpu_operations_per_second(cpu_count);
+                std::vector<double> trial_operations_per_second;
+                std::vector<log_linear_histogram> cpu_slice_durations(cpu_count);
+                std::vector<uint32_t> cpu_return_values(cpu_count);
+                std::vector<uint64_t> cpu_operation_counts(cpu_count);
+                // Hardware counters summed over the assigned CPUs of the measured trials, and the operations they
+                // cover.
+                std::optional<perf_counter_values> perf_counters;
+                uint64_t perf_counter_operations = 0;
+                if (test.perf_counters) {
+                    perf_counters.emplace();
+                }
+                // Ring buffer counts of the measured trials, and the per-trial rates.
+                std::optional<ring_buffer_result> ring_buffer;
+                std::vector<double> trial_produced_per_second;
+                std::vector<double> trial_consumed_per_second;
+                if (consumer.has_value()) {
+                    ring_buffer.emplace();
+                }
+
+                // Run the warmup runs followed by the measured trials, discarding the results of the warmup runs.
+                for (int run = 0; run < test.warmup + test.trials; run++) {
+                    prepared_state.restore();
+                    if (consumer.has_value()) {
+                        consumer->start();
+                    }
+                    auto results = run_programs_on_cpus(cpu_program_assignments, parameters);
+                    std::optional<ring_buffer_consumer_counts> consumer_counts;
+                    if (consumer.has_value()) {
+                        consumer_counts = consumer->stop();
+                    }
+
+                    // Check if any program failed or returned unexpected result.
+                    for (size_t i = 0; i < results.size(); i++) {
+                        if (cpu_program_assignments[i].has_value()) {
+                            check_result(i, results[i]);
+                        }
+                    }
+
+                    if (run < test.warmup) {
                         continue;
                     }
-                    std::cout << "CPU " << i << " Duration (ns)";
-                    if (i < opts.size() - 1) {
-                        std::cout << ",";
+
+                    // Reject the trial if the CPUs did not run concurrently for long enough to measure contention.
+                    double overlap_percent = compute_overlap_percent(cpu_program_assignments, results);
+                    if (test.min_overlap_percent.has_value() && overlap_percent < test.min_overlap_percent.value()) {
+                        throw std::runtime_error(
+                            "Test " + name + " CPU overlap " + std::to_string(overlap_percent) +
+                            "% is below the minimum " + std::to_string(test.min_overlap_percent.value()) + "%");
+                    }
+                    trial_overlap_percents.push_back(overlap_percent);
+
+                    // Average only over the CPUs that had a program assigned.
+                    double total_duration = 0;
+                    size_t total_count = 0;
+                    double total_operations_per_second = 0;
+                    for (size_t i = 0; i < results.size(); i++) {
+                        if (!cpu_program_assignments[i].has_value()) {
+                            continue;
+                        }
+                        cpu_durations[i].push_back(static_cast<double>(results[i].opts.duration));
+                        total_duration += results[i].opts.duration;
+                        total_count++;
+
+                        double operations_per_second = compute_operations_per_second(results[i]);
+                        cpu_operations_per_second[i].push_back(operations_per_second);
+                        cpu_slice_durations[i].merge(results[i].slice_durations);
+                        cpu_return_values[i] = results[i].opts.retval;
+                        cpu_operation_counts[i] += results[i].operation_count;
+                        total_operations_per_second += operations_per_second;
+                        if (perf_counters.has_value()) {
+                            *perf_counters += results[i].perf_counters;
+                            perf_counter_operations += results[i].operation_count;
+                        }
+                    }
+                    trial_average_durations.push_back(total_count ? total_duration / total_count : 0);
+                    trial_operations_per_second.push_back(total_operations_per_second);
+
+                    if (ring_buffer.has_value()) {
+                        for (size_t i = 0; i < results.size(); i++) {
+                            if (cpu_program_assignments[i].has_value()) {
+                                ring_buffer->attempted += results[i].operation_count;
+                            }
+                        }
+                        ring_buffer->consumed += consumer_counts->consumed;
+                        ring_buffer->latency.merge(consumer_counts->latency);
+                        double seconds = compute_run_seconds(cpu_program_assignments, results);
+                        trial_produced_per_second.push_back(seconds > 0 ? consumer_counts->consumed / seconds : 0);
+                        trial_consumed_per_second.push_back(
+                            seconds > 0 ? consumer_counts->consumed_while_running / seconds : 0);
                     }
                 }
-                std::cout << std::endl;
-                csv_header_printed = true;
-            }
 
-            // Print the average execution time for each program on each CPU.
-            std::cout  << to_iso8601(now) << "," << name << ",";
+                // Run the post-test command if specified.
+                if (post_test_command.has_value()) {
+                    std::string command = post_test_command.value();
+                    std::string command_output;
+                    command = std::regex_replace(command, std::regex("%NAME%"), name);
+                    command = std::regex_replace(command, std::regex("%ELF_FILE%"), test.elf_file);
+                    command = std::regex_replace(
+                        command, std::regex("%ITERATION_COUNT%"), std::to_string(parameters.iteration_count));
+                    command = std::regex_replace(command, std::regex("%CPU_COUNT%"), std::to_string(cpu_count));
+                    command = std::regex_replace(command, std::regex("%BATCH_SIZE%"), std::to_string(test.batch_size));
+
+                    if (run_command_and_capture_output(command, command_output) != 0) {
+                        std::cerr << "Post-test command failed: " << command << std::endl;
+                        std::cerr << command_output << std::endl;
+                    }
+                }
 
-            uint64_t total_duration = 0;
-            uint64_t total_count = 0;
-            for (auto opt : opts) {
-                total_duration += opt.duration;
-                total_count ++;
-            }
-            std::cout << total_duration / total_count << ",";
+                // Collect the summary of the trials for the test and for each CPU.
+                test_result result;
+                result.timestamp = to_iso8601(now);
+                result.name =
+                    sweep_point.has_value() ? name + " (" + std::to_string(sweep_point.value()) + " CPUs)" : name;
+                result.group = test.group;
+                result.parameters = test.parameters;
+                result.environment = environment;
+                result.elf_file = test.elf_file;
+                result.program_type = test.program_type;
+                result.trials = test.trials;
+                result.warmup = test.warmup;
+                result.iteration_count = parameters.iteration_count;
+                result.batch_size = test.batch_size;
+                result.min_overlap_percent = compute_summary_statistics(trial_overlap_percents).min;
+                result.operations_per_second = compute_summary_statistics(trial_operations_per_second).mean;
+                result.trial_durations = trial_average_durations;
+                result.duration = compute_summary_statistics(trial_average_durations);
+                if (cpu_baseline_durations) {
+                    // The baseline of the test as a whole is averaged over the same CPUs as its durations.
+                    std::vector<double> baseline_trial_average_durations(baseline->trials);
+                    size_t baseline_cpu_count = 0;
+                    for (size_t i = 0; i < cpu_program_assignments.size(); i++) {
+                        if (!cpu_program_assignments[i].has_value()) {
+                            continue;
+                        }
+                        for (int trial = 0; trial < baseline->trials; trial++) {
+                            baseline_trial_average_durations[trial] += (*cpu_baseline_durations)[i][trial];
+                        }
+                        baseline_cpu_count++;
+                    }
+                    for (auto& duration : baseline_trial_average_durations) {
+                        duration /= std::max<size_t>(baseline_cpu_count, 1);
+                    }
+                    result.corrected_duration = subtract_baseline(
+                        result.duration, compute_summary_statistics(baseline_trial_average_durations));
+                }
+                result.perf_counters = perf_counters;
+                result.perf_counter_operations = perf_counter_operations;
+                if (ring_buffer.has_value()) {
+                    // Every record written is eventually read, so the records not read were dropped.
+                    uint64_t dropped = ring_buffer->attempted - std::min(ring_buffer->consumed, ring_buffer->attempted);
+                    ring_buffer->drop_percent =
+                        ring_buffer->attempted > 0 ? 100.0 * dropped / ring_buffer->attempted : 0;
+                    ring_buffer->produced_per_second = compute_summary_statistics(trial_produced_per_second).mean;
+                    ring_buffer->consumed_per_second = compute_summary_statistics(trial_consumed_per_second).mean;
+                }
+                result.ring_buffer = ring_buffer;
+                for (size_t i = 0; i < cpu_program_assignments.size(); i++) {
+                    if (!cpu_program_assignments[i].has_value()) {
+                        continue;
+                    }
+                    // Merge the per-CPU slice histograms into one for the test as a whole.
+                    result.slice_durations.merge(cpu_slice_durations[i]);
+
+                    cpu_result cpu;
+                    cpu.cpu = i;
+                    cpu.numa_node = topology.location(i).node;
+                    cpu.program = test.program_names[cpu_program_assignments[i].value()];
+                    cpu.return_value = cpu_return_values[i];
+                    cpu.operation_count = cpu_operation_counts[i];
+                    cpu.trial_durations = cpu_durations[i];
+                    cpu.duration = compute_summary_statistics(cpu_durations[i]);
+                    if (cpu_baseline_durations) {
+                        cpu.corrected_duration =
+                            subtract_baseline(cpu.duration, compute_summary_statistics((*cpu_baseline_durations)[i]));
+                    }
+                    cpu.operations_per_second = compute_summary_statistics(cpu_operations_per_second[i]).mean;
+                    cpu.slice_durations = cpu_slice_durations[i];
+                    result.cpus.push_back(std::move(cpu));
+                }
 
-            for (size_t i = 0; i < opts.size(); i++) {
-                if (!cpu_program_assignments[i].has_value()) {
-                    continue;
+                if (sweep_point.has_value()) {
+                    double sweep_operations_per_second = 0;
+                    for (size_t i = 0; i < sweep_point.value(); i++) {
+                        sweep_operations_per_second +=
+                            compute_summary_statistics(cpu_operations_per_second[test.sweep_cpus[i]]).mean;
+                    }
+                    if (sweep_point.value() == 1) {
+                        single_cpu_operations_per_second = sweep_operations_per_second;
+                    }
+                    result.scaling_cpu_count = sweep_point;
+                    result.scaling_efficiency =
+                        single_cpu_operations_per_second > 0
+                            ? sweep_operations_per_second / (sweep_point.value() * single_cpu_operations_per_second)
+                            : 0;
                 }
-                auto& opt = opts[i];
-                std::cout << opt.duration;
-                if (i < opts.size() - 1) {
-                    std::cout << ",";
+                sink->write(result);
+                if (regressions.has_value()) {
+                    regressions->add(result);
                 }
             }
-            std::cout << std::endl;
         }
 
+        sink->finish();
+
+        // The comparison goes to stderr so that it doesn't mix with results written to stdout.
+        if (regressions.has_value()) {
+            size_t regressed = regressions->report(std::cerr);
+            if (regressed > 0) {
+                throw std::runtime_error(
+                    std::to_string(regressed) + (regressed == 1 ? " test" : " tests") + " regressed compared with " +
+                    previous_results_file.value());
+            }
+        }
         return 0;
     } catch (std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
@@ -0,0 +1,194 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <utility>
+
+// Two-sided 97.5% quantiles of the Student's t distribution for 1 to 30 degrees of freedom.
+static const double _t_distribution_975[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                             2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                             2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+// Normal approximation used once the degrees of freedom exceed the table.
+#define NORMAL_QUANTILE_975 1.960
+
+// Largest number of samples per set for which the exact distribution of the Mann-Whitney U statistic is used.
+#define MANN_WHITNEY_EXACT_MAX_SAMPLES 20
+
+static double
+_t_quantile_975(size_t degrees_of_freedom)
+{
+    const size_t table_size = sizeof(_t_distribution_975) / sizeof(_t_distribution_975[0]);
+    if (degrees_of_freedom == 0) {
+        return 0;
+    }
+    if (degrees_of_freedom <= table_size) {
+        return _t_distribution_975[degrees_of_freedom - 1];
+    }
+    return NORMAL_QUANTILE_975;
+}
+
+double
+percentile_of_sorted(const std::vector<double>& sorted_samples, double percentile)
+{
+    if (sorted_samples.empty()) {
+        return 0;
+    }
+    double rank = (percentile / 100.0) * static_cast<double>(sorted_samples.size() - 1);
+    size_t lower = static_cast<size_t>(std::floor(rank));
+    size_t upper = std::min(lower + 1, sorted_samples.size() - 1);
+    double fraction = rank - static_cast<double>(lower);
+    return sorted_samples[lower] + (sorted_samples[upper] - sorted_samples[lower]) * fraction;
+}
+
+summary_statistics
+compute_summary_statistics(std::vector<double> samples)
+{
+    summary_statistics summary;
+    if (samples.empty()) {
+        return summary;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    summary.sample_count = samples.size();
+    summary.min = samples.front();
+    summary.max = samples.back();
+    summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(samples.size());
+    summary.median = percentile_of_sorted(samples, 50);
+    summary.p90 = percentile_of_sorted(samples, 90);
+    summary.p99 = percentile_of_sorted(samples, 99);
+
+    if (samples.size() > 1) {
+        double sum_of_squares = 0;
+        for (double sample : samples) {
+            sum_of_squares += (sample - summary.mean) * (sample - summary.mean);
+        }
+        summary.standard_deviation = std::sqrt(sum_of_squares / static_cast<double>(samples.size() - 1));
+    }
+
+    double margin = _t_quantile_975(samples.size() - 1) * summary.standard_deviation /
+                    std::sqrt(static_cast<double>(samples.size()));
+    summary.ci95_lower = summary.mean - margin;
+    summary.ci95_upper = summary.mean + margin;
+    return summary;
+}
+
+baseline_correction
+subtract_baseline(const summary_statistics& measured, const summary_statistics& baseline)
+{
+    double measured_margin = measured.ci95_upper - measured.mean;
+    double baseline_margin = baseline.ci95_upper - baseline.mean;
+    double margin = std::sqrt(measured_margin * measured_margin + baseline_margin * baseline_margin);
+
+    baseline_correction correction;
+    correction.baseline = baseline.mean;
+    correction.mean = measured.mean - baseline.mean;
+    correction.ci95_lower = correction.mean - margin;
+    correction.ci95_upper = correction.mean + margin;
+    return correction;
+}
+
+// Compute the probability that the U statistic of samples of the given sizes is at most u, when neither set tends to
+// be larger than the other and there are no ties.
+static double
+_mann_whitney_u_cdf(size_t first_count, size_t second_count, double u)
+{
+    // counts[j][k] is the number of orderings of i samples of the first set and j of the second in which k pairs have
+    // the sample of the first set larger, built up one sample of the first set at a time. The largest sample of i and
+    // j is either from the first set, which then exceeds all j of the second, or from the second.
+    std::vector<std::vector<double>> counts(second_count + 1, std::vector<double>(1, 1));
+    for (size_t i = 1; i <= first_count; i++) {
+        std::vector<std::vector<double>> next(second_count + 1);
+        next[0] = {1};
+        for (size_t j = 1; j <= second_count; j++) {
+            next[j].assign(i * j + 1, 0);
+            for (size_t k = 0; k < counts[j].size(); k++) {
+                next[j][k + j] += counts[j][k];
+            }
+            for (size_t k = 0; k < next[j - 1].size(); k++) {
+                next[j][k] += next[j - 1][k];
+            }
+        }
+        counts = std::move(next);
+    }
+
+    double total = 0;
+    double at_most_u = 0;
+    for (size_t k = 0; k < counts[second_count].size(); k++) {
+        total += counts[second_count][k];
+        if (static_cast<double>(k) <= u) {
+            at_most_u += counts[second_count][k];
+        }
+    }
+    return at_most_u / total;
+}
+
+double
+mann_whitney_u_p_value(const std::vector<double>& first, const std::vector<double>& second)
+{
+    if (first.empty() || second.empty()) {
+        return 1;
+    }
+
+    // Rank the samples of both sets together, giving tied samples the mean of their ranks.
+    std::vector<std::pair<double, bool>> samples;
+    for (double sample : first) {
+        samples.push_back({sample, true});
+    }
+    for (double sample : second) {
+        samples.push_back({sample, false});
+    }
+    std::sort(samples.begin(), samples.end());
+
+    double first_rank_sum = 0;
+    double tie_correction = 0;
+    for (size_t i = 0; i < samples.size();) {
+        size_t end = i;
+        while (end < samples.size() && samples[end].first == samples[i].first) {
+            end++;
+        }
+        double tie_count = static_cast<double>(end - i);
+        double rank = (static_cast<double>(i + 1) + static_cast<double>(end)) / 2;
+        for (size_t j = i; j < end; j++) {
+            if (samples[j].second) {
+                first_rank_sum += rank;
+            }
+        }
+        tie_correction += tie_count * tie_count * tie_count - tie_count;
+        i = end;
+    }
+
+    double n1 = static_cast<double>(first.size());
+    double n2 = static_cast<double>(second.size());
+    double n = n1 + n2;
+    double u = first_rank_sum - n1 * (n1 + 1) / 2;
+    double smaller_u = std::min(u, n1 * n2 - u);
+
+    if (tie_correction == 0 && first.size() <= MANN_WHITNEY_EXACT_MAX_SAMPLES &&
+        second.size() <= MANN_WHITNEY_EXACT_MAX_SAMPLES) {
+        return std::min(1.0, 2 * _mann_whitney_u_cdf(first.size(), second.size(), smaller_u));
+    }
+
+    double variance = n1 * n2 / 12 * ((n + 1) - tie_correction / (n * (n - 1)));
+    if (variance <= 0) {
+        return 1;
+    }
+    // Continuity correction for the discrete U.
+    double z = std::max(0.0, (n1 * n2 / 2 - smaller_u - 0.5) / std::sqrt(variance));
+    return std::min(1.0, std::erfc(z / std::sqrt(2.0)));
+}
+
+double
+mann_whitney_u_min_p_value(size_t first_count, size_t second_count)
+{
+    std::vector<double> first(first_count);
+    std::vector<double> second(second_count);
+    std::iota(first.begin(), first.end(), 0);
+    std::iota(second.begin(), second.end(), static_cast<double>(first_count));
+    return mann_whitney_u_p_value(first, second);
+}
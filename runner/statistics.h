@@ -0,0 +1,102 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Summary statistics computed over a set of samples, such as the per-trial durations of a test.
+ */
+struct summary_statistics
+{
+    size_t sample_count = 0;
+    double min = 0;
+    double max = 0;
+    double mean = 0;
+    double median = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double standard_deviation = 0;
+    // Bounds of the two-sided 95% confidence interval of the mean.
+    double ci95_lower = 0;
+    double ci95_upper = 0;
+};
+
+/**
+ * @brief Compute the value at the given percentile using linear interpolation between the closest ranks.
+ *
+ * @param[in] sorted_samples Samples sorted in ascending order.
+ * @param[in] percentile Percentile in the range [0, 100].
+ * @return The interpolated value, or 0 if there are no samples.
+ */
+double
+percentile_of_sorted(const std::vector<double>& sorted_samples, double percentile);
+
+/**
+ * @brief Compute summary statistics for a set of samples.
+ *
+ * The standard deviation is the sample standard deviation and the confidence interval uses the Student's t
+ * distribution, so both are meaningful for the small sample counts produced by repeated trials. With a single
+ * sample the standard deviation is 0 and the confidence interval collapses to the mean.
+ *
+ * @param[in] samples Samples to summarize, in any order.
+ * @return The summary statistics.
+ */
+summary_statistics
+compute_summary_statistics(std::vector<double> samples);
+
+/**
+ * @brief A mean with the mean of a baseline subtracted, such as a duration with the overhead of the test harness
+ * removed.
+ */
+struct baseline_correction
+{
+    // Mean of the baseline that was subtracted.
+    double baseline = 0;
+    double mean = 0;
+    // Bounds of the two-sided 95% confidence interval of the difference.
+    double ci95_lower = 0;
+    double ci95_upper = 0;
+};
+
+/**
+ * @brief Subtract the mean of a baseline from the mean of a measurement.
+ *
+ * The two are measured independently, so the half-widths of their confidence intervals are combined in quadrature.
+ *
+ * @param[in] measured Summary of the measurement.
+ * @param[in] baseline Summary of the baseline.
+ * @return The corrected mean and its confidence interval.
+ */
+baseline_correction
+subtract_baseline(const summary_statistics& measured, const summary_statistics& baseline);
+
+/**
+ * @brief Compute the two-sided p-value of the Mann-Whitney U test of whether two sets of samples, such as the per-trial
+ * durations of two runs of a test, come from the same distribution.
+ *
+ * Unlike a test on the means, it makes no assumption about the shape of the distributions, so a few outlying trials
+ * do not decide the result. Small samples without ties use the exact distribution of U, and others its normal
+ * approximation with a correction for ties. Whether a difference can be significant depends on both sample sizes
+ * together: at the 5% level it takes at least 2 and 8, 3 and 5, or 4 and 4 samples, and with a single sample on
+ * either side no difference ever is. mann_whitney_u_min_p_value gives the smallest p-value for any two sizes.
+ *
+ * @param[in] first First set of samples.
+ * @param[in] second Second set of samples.
+ * @return The p-value, or 1 if either set is empty.
+ */
+double
+mann_whitney_u_p_value(const std::vector<double>& first, const std::vector<double>& second);
+
+/**
+ * @brief Compute the smallest p-value mann_whitney_u_p_value can return for two sets of samples of the given sizes,
+ * which it returns when every sample of one set is smaller than every sample of the other.
+ *
+ * @param[in] first_count Number of samples in the first set.
+ * @param[in] second_count Number of samples in the second set.
+ * @return The smallest p-value, or 1 if either set is empty.
+ */
+double
+mann_whitney_u_min_p_value(size_t first_count, size_t second_count);
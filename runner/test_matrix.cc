@@ -0,0 +1,186 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#include "test_matrix.h"
+
+#include <map>
+#include <stdexcept>
+
+typedef std::map<std::string, YAML::Node> matrix_values;
+
+// Render a matrix value for use inside a string.
+static std::string
+_value_to_string(const std::string& variable, const YAML::Node& value)
+{
+    if (value.IsScalar()) {
+        return value.as<std::string>();
+    }
+    if (value.IsSequence()) {
+        std::string result;
+        for (auto element : value) {
+            if (!element.IsScalar()) {
+                throw std::runtime_error("Matrix variable " + variable + " can only be used as a whole value");
+            }
+            result += (result.empty() ? "" : " ") + element.as<std::string>();
+        }
+        return result;
+    }
+    if (value.IsMap() && value["name"].IsDefined() && value["name"].IsScalar()) {
+        return value["name"].as<std::string>();
+    }
+    throw std::runtime_error("Matrix variable " + variable + " has no name field");
+}
+
+// Look up a variable, which is either a dimension name or a dimension name and a field of its map value.
+static YAML::Node
+_lookup_variable(const std::string& variable, const matrix_values& values)
+{
+    auto dot = variable.find('.');
+    auto value = values.find(variable.substr(0, dot));
+    if (value == values.end()) {
+        throw std::runtime_error("Unknown matrix variable " + variable);
+    }
+    if (dot == std::string::npos) {
+        return value->second;
+    }
+    if (!value->second.IsMap() || !value->second[variable.substr(dot + 1)].IsDefined()) {
+        throw std::runtime_error("Unknown matrix variable " + variable);
+    }
+    return value->second[variable.substr(dot + 1)];
+}
+
+// Replace every ${variable} in a string. If the string is a single variable, its value is returned as is.
+static YAML::Node
+_substitute_string(const std::string& text, const matrix_values& values)
+{
+    if (text.size() > 3 && text.starts_with("${") && text.find('}') == text.size() - 1) {
+        return YAML::Clone(_lookup_variable(text.substr(2, text.size() - 3), values));
+    }
+
+    std::string result;
+    size_t position = 0;
+    for (size_t start = text.find("${"); start != std::string::npos; start = text.find("${", position)) {
+        size_t end = text.find('}', start);
+        if (end == std::string::npos) {
+            throw std::runtime_error("Unterminated matrix variable in " + text);
+        }
+        std::string variable = text.substr(start + 2, end - start - 2);
+        result += text.substr(position, start - position);
+        result += _value_to_string(variable, _lookup_variable(variable, values));
+        position = end + 1;
+    }
+    result += text.substr(position);
+    return YAML::Node(result);
+}
+
+// Copy a node, substituting the variables in every scalar and map key.
+static YAML::Node
+_substitute(const YAML::Node& node, const matrix_values& values)
+{
+    if (node.IsScalar()) {
+        return _substitute_string(node.as<std::string>(), values);
+    }
+    if (node.IsSequence()) {
+        YAML::Node result(YAML::NodeType::Sequence);
+        for (auto element : node) {
+            result.push_back(_substitute(element, values));
+        }
+        return result;
+    }
+    if (node.IsMap()) {
+        YAML::Node result(YAML::NodeType::Map);
+        for (auto element : node) {
+            auto key = _substitute_string(element.first.as<std::string>(), values);
+            if (!key.IsScalar()) {
+                throw std::runtime_error(
+                    "Matrix variable in key " + element.first.as<std::string>() + " must be a scalar");
+            }
+            result[key.as<std::string>()] = _substitute(element.second, values);
+        }
+        return result;
+    }
+    return YAML::Clone(node);
+}
+
+// Name a test group after a template name, replacing each ${variable} with <variable>.
+static std::string
+_template_group(const std::string& name)
+{
+    std::string result;
+    size_t position = 0;
+    for (size_t start = name.find("${"); start != std::string::npos; start = name.find("${", position)) {
+        size_t end = name.find('}', start);
+        if (end == std::string::npos) {
+            break;
+        }
+        result += name.substr(position, start - position) + "<" + name.substr(start + 2, end - start - 2) + ">";
+        position = end + 1;
+    }
+    return result + name.substr(position);
+}
+
+std::vector<expanded_test>
+expand_test_matrix(const YAML::Node& test)
+{
+    std::string name = test["name"].IsDefined() && test["name"].IsScalar() ? test["name"].as<std::string>() : "";
+    auto matrix = test["matrix"];
+    if (!matrix) {
+        expanded_test expanded;
+        expanded.test = test;
+        expanded.group = test["group"].IsDefined() ? test["group"].as<std::string>() : name;
+        return {expanded};
+    }
+
+    if (!matrix.IsMap() || matrix.size() == 0) {
+        throw std::runtime_error("Field matrix must be a map of dimension names to lists of values");
+    }
+
+    std::vector<std::pair<std::string, YAML::Node>> dimensions;
+    for (auto dimension : matrix) {
+        auto dimension_name = dimension.first.as<std::string>();
+        if (!dimension.second.IsSequence() || dimension.second.size() == 0) {
+            throw std::runtime_error("Field matrix." + dimension_name + " must be a non-empty sequence");
+        }
+        dimensions.push_back({dimension_name, dimension.second});
+    }
+
+    YAML::Node template_test(YAML::NodeType::Map);
+    for (auto field : test) {
+        auto field_name = field.first.as<std::string>();
+        if (field_name != "matrix" && field_name != "group") {
+            template_test[field_name] = field.second;
+        }
+    }
+    std::string group = test["group"].IsDefined() ? test["group"].as<std::string>() : _template_group(name);
+
+    // Step through every combination like an odometer, with the last dimension varying fastest.
+    std::vector<expanded_test> expanded_tests;
+    std::vector<size_t> indices(dimensions.size(), 0);
+    for (;;) {
+        matrix_values values;
+        expanded_test expanded;
+        expanded.group = group;
+        for (size_t i = 0; i < dimensions.size(); i++) {
+            auto& [dimension_name, dimension_values] = dimensions[i];
+            const YAML::Node value = dimension_values[indices[i]];
+            values.emplace(dimension_name, value);
+            // Map values without a name are identified by their position.
+            std::string parameter = value.IsMap() && !(value["name"].IsDefined() && value["name"].IsScalar())
+                                        ? std::to_string(indices[i])
+                                        : _value_to_string(dimension_name, value);
+            expanded.parameters.push_back({dimension_name, parameter});
+        }
+        expanded.test = _substitute(template_test, values);
+        expanded_tests.push_back(std::move(expanded));
+
+        size_t dimension = dimensions.size();
+        while (dimension > 0 && ++indices[dimension - 1] == dimensions[dimension - 1].second.size()) {
+            indices[dimension - 1] = 0;
+            dimension--;
+        }
+        if (dimension == 0) {
+            break;
+        }
+    }
+    return expanded_tests;
+}
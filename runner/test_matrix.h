@@ -0,0 +1,39 @@
+// Copyright (c) Microsoft Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+
+/**
+ * @brief One test of the YAML file, after expanding its matrix if it has one.
+ */
+struct expanded_test
+{
+    // The test with every matrix variable substituted and the matrix field removed.
+    YAML::Node test;
+    // Name that all tests expanded from the same template share, for grouping results.
+    std::string group;
+    // The value of each matrix dimension for this test, in the order the dimensions were declared.
+    std::vector<std::pair<std::string, std::string>> parameters;
+};
+
+/**
+ * @brief Expand a test with a matrix field into one test per combination of the matrix values.
+ *
+ * Each dimension of the matrix is a name and a list of values. Every string in the test, including map keys such as
+ * program names, has ${name} replaced by the value of that dimension. A value can be a scalar, a sequence such as a
+ * list of CPUs, or a map, whose fields are referenced as ${name.field} and whose "name" field is used for ${name}. A
+ * string that is only ${name} is replaced by the value itself, so that sequences and maps keep their structure.
+ * Combinations are generated with the first dimension varying slowest.
+ *
+ * A test without a matrix is returned as is.
+ *
+ * @param[in] test The YAML node of the test.
+ * @return The expanded tests.
+ */
+std::vector<expanded_test>
+expand_test_matrix(const YAML::Node& test);
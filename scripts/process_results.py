@@ -7,6 +7,7 @@
 import argparse
 import csv
 import datetime
+import json
 import os
 import re
 import sys
@@ -22,6 +23,9 @@ TIMESTAMP_COLUMN_NAME = "Timestamp"
 METRIC_COLUMN_NAME = "Test"
 # The fourth column is the name of the value.
 VALUE_COLUMN_NAME = "Average Duration (ns)"
+# Per-CPU columns are named after the CPU they were measured on.
+CPU_VALUE_COLUMN_PATTERN = re.compile(r"^CPU (\d+) Duration \(ns\)$")
+CPU_PROGRAM_COLUMN_FORMAT = "CPU {} Program"
 
 # The following are the names of the columns in the SQL script.
 # The first column is the timestamp column.
@@ -37,14 +41,16 @@ PLATFORM_SQL_COLUMN_NAME = "Platform"
 # The sixth column is the repository column.
 REPOSITORY_SQL_COLUMN_NAME = "Repository"
 
-# Parse all CSV files in the given directory and return a dictionary.
-# The keys of the dictionary are the names of the CSV files.
-# The values of the dictionary are the contents of the CSV files.
+# Parse all CSV and JSON Lines files in the given directory and return a dictionary.
+# The keys of the dictionary are the names of the files.
+# The values of the dictionary are the contents of the files, as CSV rows.
 
 def parse_csv_files(csv_directory):
     csv_files = {}
     for csv_file in csv_directory.glob("*.csv"):
         csv_files[csv_file.resolve()] = parse_csv_file(csv_file)
+    for jsonl_file in csv_directory.glob("*.jsonl"):
+        csv_files[jsonl_file.resolve()] = parse_jsonl_file(jsonl_file)
     return csv_files
 
 # Parse the given CSV file and return a list of dictionaries.
@@ -60,13 +66,49 @@ def parse_csv_file(csv_file):
             csv_rows.append(csv_row)
     return csv_rows
 
+# Parse the given JSON Lines file written by the runner with "--format jsonl" and return a list of dictionaries.
+# Each record is converted to the columns of the equivalent CSV row.
+
+def parse_jsonl_file(jsonl_file):
+    csv_rows = []
+    with open(jsonl_file, "r") as jsonl_file_handle:
+        for line in jsonl_file_handle:
+            # Skip anything that is not a result record, such as messages printed with "-r".
+            if not line.startswith("{"):
+                continue
+            record = json.loads(line)
+            csv_row = {
+                TIMESTAMP_COLUMN_NAME: record["timestamp"],
+                METRIC_COLUMN_NAME: record["test"],
+                VALUE_COLUMN_NAME: str(round(record["duration_ns"]["mean"])),
+            }
+            for cpu in record["cpus"]:
+                csv_row[CPU_PROGRAM_COLUMN_FORMAT.format(cpu["cpu"])] = cpu["program"]
+                csv_row["CPU {} Duration (ns)".format(cpu["cpu"])] = str(round(cpu["duration_ns"]["mean"]))
+            csv_rows.append(csv_row)
+    return csv_rows
+
+# Get the metrics to record for the given row: the average duration of the test and, if requested, the average
+# duration of each CPU, named after the test, the CPU and the program it ran.
+
+def get_row_metrics(csv_row, per_cpu):
+    metrics = [(csv_row[METRIC_COLUMN_NAME], csv_row[VALUE_COLUMN_NAME])]
+    if per_cpu:
+        for column_name, value in csv_row.items():
+            match = CPU_VALUE_COLUMN_PATTERN.match(column_name or "")
+            if match and value:
+                cpu = match.group(1)
+                program = csv_row.get(CPU_PROGRAM_COLUMN_FORMAT.format(cpu), "")
+                metrics.append((f"{csv_row[METRIC_COLUMN_NAME]} (CPU {cpu} {program})", value))
+    return metrics
+
 # Convert the given CSV file to a SQL script and write it to the given file.
 # The CSV file is assumed to be a dictionary.
 # The keys of the dictionary are the names of the columns.
 # The values of the dictionary are the values of the columns.
 
-def convert_csv_file_to_sql_script(csv_file, sql_script_file, commit_id, platform, repository):
-    csv_rows = parse_csv_file(csv_file)
+def convert_csv_file_to_sql_script(csv_file, sql_script_file, commit_id, platform, repository, per_cpu=False):
+    csv_rows = parse_jsonl_file(csv_file) if Path(csv_file).suffix == ".jsonl" else parse_csv_file(csv_file)
     sql_script_file.write("INSERT INTO BenchmarkResults (")
     sql_script_file.write(f"{TIMESTAMP_SQL_COLUMN_NAME}, ")
     sql_script_file.write(f"{METRIC_SQL_COLUMN_NAME}, ")
@@ -76,22 +118,20 @@ def convert_csv_file_to_sql_script(csv_file, sql_script_file, commit_id, platfor
     sql_script_file.write(f"{REPOSITORY_SQL_COLUMN_NAME}")
     sql_script_file.write(")\n")
     sql_script_file.write("VALUES\n")
+    values = []
     for csv_row in csv_rows:
         # Skip rows that do not have a metric.
         if csv_row[METRIC_COLUMN_NAME] == None or csv_row[METRIC_COLUMN_NAME] == "":
             continue
-        sql_script_file.write("(")
-        sql_script_file.write(f"'{csv_row[TIMESTAMP_COLUMN_NAME]}', ")
-        sql_script_file.write(f"'{csv_row[METRIC_COLUMN_NAME]}', ")
-        sql_script_file.write(f"{csv_row[VALUE_COLUMN_NAME]}, ")
-        sql_script_file.write(f"'{commit_id}', ")
-        sql_script_file.write(f"'{platform}',")
-        sql_script_file.write(f"'{repository}'")
-        # Write a comma if this is not the last row.
-        if csv_row != csv_rows[-1]:
-            sql_script_file.write("),\n")
-        else:
-            sql_script_file.write(")")
+        for metric, value in get_row_metrics(csv_row, per_cpu):
+            values.append(
+                f"('{csv_row[TIMESTAMP_COLUMN_NAME]}', "
+                f"'{metric}', "
+                f"{value}, "
+                f"'{commit_id}', "
+                f"'{platform}',"
+                f"'{repository}')")
+    sql_script_file.write(",\n".join(values))
     sql_script_file.write(";\n")
 
 # Convert the given CSV files to a SQL script and write it to the given file.
@@ -99,9 +139,9 @@ def convert_csv_file_to_sql_script(csv_file, sql_script_file, commit_id, platfor
 # The keys of the dictionary are the names of the CSV files.
 # The values of the dictionary are the contents of the CSV files.
 
-def convert_csv_files_to_sql_script(csv_files, sql_script_file, commit_id, platform, repository):
+def convert_csv_files_to_sql_script(csv_files, sql_script_file, commit_id, platform, repository, per_cpu=False):
     for csv_file_name, csv_file in csv_files.items():
-        convert_csv_file_to_sql_script(csv_file_name, sql_script_file, commit_id, platform, repository)
+        convert_csv_file_to_sql_script(csv_file_name, sql_script_file, commit_id, platform, repository, per_cpu)
 
 # Main entry point.
 
@@ -112,11 +152,13 @@ def main():
     parser.add_argument("--commit_id", type=str, required=True)
     parser.add_argument("--platform", type=str, required=True)
     parser.add_argument("--repository", type=str, required=True)
+    parser.add_argument("--per-cpu", action="store_true", help="Also record the average duration of each CPU")
     args = parser.parse_args()
 
     csv_files = parse_csv_files(args.csv_directory)
     with open(args.sql_script_file, "w") as sql_script_file:
-        convert_csv_files_to_sql_script(csv_files, sql_script_file, args.commit_id, args.platform, args.repository)
+        convert_csv_files_to_sql_script(
+            csv_files, sql_script_file, args.commit_id, args.platform, args.repository, args.per_cpu)
 
 if __name__ == "__main__":
     main()
\ No newline at end of file